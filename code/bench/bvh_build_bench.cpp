@@ -0,0 +1,51 @@
+/*
+原创性：独立实现
+*/
+
+// Benchmark of the BVH build on one thread against the parallel build.
+// Build with -DPA4_BENCH=ON and run PA4_bvh_build_bench [triangles] [threads].
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <omp.h>
+#include "bvh.hpp"
+
+// build time in ms; order receives the primitive order of the leaves
+static double run(const std::vector <volume3d> &volumes, BVH::Builder builder, int threads, std::vector <int> &order) {
+    BVH bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(volumes, order, builder, threads);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    int nTriangles = argc > 1 ? atoi(argv[1]) : 2000000;
+    int threads = argc > 2 ? atoi(argv[2]) : omp_get_max_threads();
+    std::mt19937_64 rnd(2024);
+    std::uniform_real_distribution <float> gen(-1, 1);
+    // small triangles clustered on a few blobs, as in a scanned asset
+    std::vector <volume3d> volumes(nTriangles);
+    for (int i = 0; i < nTriangles; i++) {
+        Vector3f blob(i % 7 - 3, i % 5 - 2, i % 3 - 1);
+        Vector3f a = blob + Vector3f(gen(rnd), gen(rnd), gen(rnd));
+        volumes[i].merge(a);
+        volumes[i].merge(a + Vector3f(gen(rnd), gen(rnd), gen(rnd)) * 0.01);
+        volumes[i].merge(a + Vector3f(gen(rnd), gen(rnd), gen(rnd)) * 0.01);
+    }
+    printf("%d triangles, %d threads\n", nTriangles, threads);
+    bool same = true;
+    for (BVH::Builder builder : {BVH::MEDIAN, BVH::SAH}) {
+        std::vector <int> serial, parallel;
+        double msSerial = run(volumes, builder, 1, serial);
+        double msParallel = run(volumes, builder, threads, parallel);
+        same = same && serial == parallel;
+        printf("%-6s: 1 thread %.1f ms, %d threads %.1f ms, speedup %.2fx%s\n",
+            builder == BVH::SAH ? "SAH" : "median", msSerial, threads, msParallel, msSerial / msParallel,
+            serial == parallel ? "" : " (trees differ)");
+    }
+    return !same;
+}
@@ -0,0 +1,101 @@
+/*
+原创性：独立实现
+*/
+
+// Micro-benchmark of the ray-triangle test written with the vecmath Vector3f
+// against the same test written with the header-only Vec3.
+// Build with -DPA4_BENCH=ON and run PA4_vec3_bench [triangles] [rays].
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <vecmath.h>
+#include "vec3.hpp"
+
+template <typename V>
+struct triangle {
+    V A, edge1, edge2;
+};
+
+static bool intersect(const triangle <Vector3f> &tr, const Vector3f &o, const Vector3f &d, float tmin, float &tmax) {
+    Vector3f p = Vector3f::cross(d, tr.edge2);
+    float a = Vector3f::dot(tr.edge1, p);
+    if (fabsf(a) < 1e-8) return false;
+    float f = 1 / a;
+    Vector3f s = o - tr.A;
+    float u = f * Vector3f::dot(s, p);
+    if (u < 0 || u > 1) return false;
+    Vector3f q = Vector3f::cross(s, tr.edge1);
+    float v = f * Vector3f::dot(d, q);
+    if (v < 0 || u + v > 1) return false;
+    float t = f * Vector3f::dot(q, tr.edge2);
+    if (t < tmin || t > tmax) return false;
+    tmax = t;
+    return true;
+}
+
+static bool intersect(const triangle <Vec3> &tr, const Vec3 &o, const Vec3 &d, float tmin, float &tmax) {
+    Vec3 p = Vec3::cross(d, tr.edge2);
+    float a = Vec3::dot(tr.edge1, p);
+    if (fabsf(a) < 1e-8) return false;
+    float f = 1 / a;
+    Vec3 s = o - tr.A;
+    float u = f * Vec3::dot(s, p);
+    if (u < 0 || u > 1) return false;
+    Vec3 q = Vec3::cross(s, tr.edge1);
+    float v = f * Vec3::dot(d, q);
+    if (v < 0 || u + v > 1) return false;
+    float t = f * Vec3::dot(q, tr.edge2);
+    if (t < tmin || t > tmax) return false;
+    tmax = t;
+    return true;
+}
+
+// every ray against every triangle, returns the number of hits and the time in ns per test
+template <typename V>
+static long long run(const std::vector <triangle <V>> &tris, const std::vector <V> &origins,
+    const std::vector <V> &dirs, double &ns) {
+    long long hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < origins.size(); r++) {
+        float tmax = 1e38;
+        for (const auto &tr : tris)
+            hits += intersect(tr, origins[r], dirs[r], 1e-4, tmax);
+    }
+    auto end = std::chrono::steady_clock::now();
+    ns = std::chrono::duration <double, std::nano> (end - start).count() / (double(tris.size()) * origins.size());
+    return hits;
+}
+
+int main(int argc, char *argv[]) {
+    int nTriangles = argc > 1 ? atoi(argv[1]) : 4096;
+    int nRays = argc > 2 ? atoi(argv[2]) : 4096;
+    std::mt19937_64 rnd(2024);
+    std::uniform_real_distribution <float> gen(-1, 1);
+    std::vector <triangle <Vector3f>> trisA(nTriangles);
+    std::vector <triangle <Vec3>> trisB(nTriangles);
+    for (int i = 0; i < nTriangles; i++) {
+        Vector3f a(gen(rnd), gen(rnd), gen(rnd));
+        Vector3f b = a + Vector3f(gen(rnd), gen(rnd), gen(rnd)) * 0.2;
+        Vector3f c = a + Vector3f(gen(rnd), gen(rnd), gen(rnd)) * 0.2;
+        trisA[i] = {a, b - a, c - a};
+        trisB[i] = {Vec3(a), Vec3(b - a), Vec3(c - a)};
+    }
+    std::vector <Vector3f> originsA(nRays), dirsA(nRays);
+    std::vector <Vec3> originsB(nRays), dirsB(nRays);
+    for (int i = 0; i < nRays; i++) {
+        originsA[i] = Vector3f(gen(rnd), gen(rnd), -3);
+        dirsA[i] = (Vector3f(gen(rnd), gen(rnd), 0) - originsA[i]).normalized();
+        originsB[i] = Vec3(originsA[i]), dirsB[i] = Vec3(dirsA[i]);
+    }
+    double nsA, nsB;
+    long long hitsA = run(trisA, originsA, dirsA, nsA);
+    long long hitsB = run(trisB, originsB, dirsB, nsB);
+    printf("%d triangles x %d rays\n", nTriangles, nRays);
+    printf("Vector3f: %.3f ns per test, %lld hits\n", nsA, hitsA);
+    printf("Vec3:     %.3f ns per test, %lld hits\n", nsB, hitsB);
+    printf("speedup:  %.2fx\n", nsA / nsB);
+    return hitsA != hitsB;
+}
@@ -0,0 +1,227 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include "volume.hpp"
+#include "ray.hpp"
+
+// Bounding volume hierarchy over primitives described only by their volumes.
+// Leaves report primitive indices, so it serves both Mesh and Group.
+// Nodes are stored depth-first: the left child of node p is p + 1.
+class BVH {
+public:
+    enum Builder {
+        MEDIAN, // median split on the longest axis
+        SAH     // binned surface area heuristic
+    };
+
+    // order[i] is the input primitive that leaves refer to as i; callers
+    // reorder their primitives by it so that every leaf covers a contiguous range.
+    // With threads > 1, subtrees are built as parallel tasks and the top levels
+    // bin and partition in parallel; the tree is the same for any thread count.
+    void build(const std::vector <volume3d> &volumes, std::vector <int> &order, Builder builder = MEDIAN,
+        int threads = 1);
+
+    // Collapse the built binary tree into 4- or 8-wide nodes whose child boxes
+    // are tested together with SSE / AVX2. width = 2 keeps the binary traversal.
+    void widen(int width);
+
+    // node count, SAH cost, leaf size histogram and memory of the built tree
+    void printStatistics() const;
+
+    // Continues the FNV-1a hash with everything besides the primitives that decides
+    // the tree built by builder and widened to width, for the key of a BVH cache.
+    static uint64_t hashSettings(uint64_t hash, Builder builder, int width);
+
+    // bytes per node in nodeData, which a cache file stores as they are
+    static const size_t nodeSize = 32;
+
+    // The binary nodes as bytes, so that Mesh can keep its BVH in a cache file.
+    // setNodes takes bytes from nodeData of a tree over primitives primitives,
+    // returns false if they do not form one, and has to be followed by widen.
+    const void *nodeData() const {
+        return nodes.data();
+    }
+    size_t nodeBytes() const {
+        return nodes.size() * sizeof(bvhNode);
+    }
+    bool setNodes(const void *data, size_t bytes, int primitives);
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    const volume3d &getVolume() const {
+        return nodes[0].volume;
+    }
+
+    // the build never goes deeper than this, so traversal can use a fixed stack
+    static const int maxDepth = 64;
+
+    // Calls leaf(first, count) for every leaf range of primitives not culled by tmax.
+    // tmax is re-read after every leaf, so leaves shrink it as they find closer hits;
+    // setting it below zero ends the traversal, which any-hit queries use.
+    template <typename F>
+    void intersect(const Ray &r, const float &tmax, F &&leaf) const {
+        if (width == 4) intersectWide <4> (nodes4, r, tmax, leaf);
+        else if (width == 8) intersectWide <8> (nodes8, r, tmax, leaf);
+        else intersectBinary(r, tmax, leaf);
+    }
+
+    // Packet version of intersect over the binary tree: calls leaf(first, count, mask)
+    // with the mask of the rays whose boxes reach the leaf. mask selects the rays to
+    // trace and tmax[i] is re-read like tmax above.
+    template <typename F>
+    void intersect(const RayPacket &p, const float *tmax, int mask, F &&leaf) const {
+        if (p.size <= 4) intersectPacket <4> (p, tmax, mask, leaf);
+        else if (p.size <= 8) intersectPacket <8> (p, tmax, mask, leaf);
+        else intersectPacket <RayPacket::maxSize> (p, tmax, mask, leaf);
+    }
+
+private:
+    // two nodes per cache line
+    struct alignas(32) bvhNode {
+        volume3d volume;
+        int offset; // leaf: first primitive, inner node: right child
+        int count;  // leaf: number of primitives, inner node: 0
+    };
+    static_assert(sizeof(bvhNode) == nodeSize, "bvhNode should stay nodeSize bytes");
+
+    // W children with their bounds stored per axis, so one SIMD register holds
+    // the same bound of every child
+    template <int W>
+    struct alignas(32) wideNode {
+        float dmin[3][W], dmax[3][W];
+        int offset[W]; // leaf: first primitive, inner node: wide node index
+        int count[W];  // leaf: number of primitives, inner node: 0, empty slot: -1
+    };
+
+    std::vector <bvhNode> nodes;
+    std::vector <wideNode <4>> nodes4;
+    std::vector <wideNode <8>> nodes8;
+    int width = 2;
+
+    struct buildContext;
+    // appends the subtree over primitives [l, r) to out, depth-first with offsets relative to out
+    static void buildSubtree(buildContext &c, int l, int r, int depth, std::vector <bvhNode> &out);
+
+    // entry distances of all children into tnear, returns the mask of children hit before tmax
+    static int intersectChildren(const wideNode <4> &node, const RayQuery &q, float tmax, float *tnear);
+    static int intersectChildren(const wideNode <8> &node, const RayQuery &q, float tmax, float *tnear);
+
+    template <int W>
+    void collapse(std::vector <wideNode <W>> &wide) const;
+
+    template <int W, typename F>
+    void intersectWide(const std::vector <wideNode <W>> &wide, const Ray &r, const float &tmax, F &&leaf) const {
+        if (nodes.empty()) return;
+        RayQuery q(r);
+        float t;
+        if (!nodes[0].volume.intersect(q, t) || t > tmax) return;
+        struct entry {
+            int offset, count;
+            float dist;
+        } stack[maxDepth * W];
+        int top = 0;
+        stack[top++] = {0, 0, t};
+        while (top) {
+            entry e = stack[--top];
+            if (e.dist > tmax) continue;
+            if (e.count) {
+                leaf(e.offset, e.count);
+                continue;
+            }
+            const wideNode <W> &node = wide[e.offset];
+            float tnear[W];
+            int mask = intersectChildren(node, q, tmax, tnear);
+            // keep the children just pushed sorted so that the nearest is popped first
+            int base = top;
+            for (int k = 0; k < W; k++) {
+                if (!(mask >> k & 1)) continue;
+                entry c = {node.offset[k], node.count[k], tnear[k]};
+                int j = top++;
+                while (j > base && stack[j - 1].dist < c.dist)
+                    stack[j] = stack[j - 1], j--;
+                stack[j] = c;
+            }
+        }
+    }
+
+    // the rays of mask whose entry into the box comes before their tmax; the same
+    // test as volume3d::intersect, so a packet culls exactly what single rays do
+    static int packetMask(const volume3d &volume, const RayPacket &p, const float *tmax, int mask, int n);
+
+    template <int N, typename F>
+    void intersectPacket(const RayPacket &p, const float *tmax, int mask, F &&leaf) const {
+        if (nodes.empty()) return;
+        // a node is tested when it is popped, against the tmax of that moment
+        struct entry {
+            int node, mask;
+        } stack[maxDepth + 2];
+        int top = 0;
+        stack[top++] = {0, mask};
+        while (top) {
+            entry e = stack[--top];
+            const bvhNode &node = nodes[e.node];
+            int active = packetMask(node.volume, p, tmax, e.mask, N);
+            if (!active) continue;
+            if (node.count) {
+                leaf(node.offset, node.count, active);
+                continue;
+            }
+            // visit first the child whose center comes first along the first active ray
+            int near = e.node + 1, far = node.offset, l = __builtin_ctz(active);
+            float dNear = 0, dFar = 0;
+            for (int d = 0; d < 3; d++) {
+                float dir = p.rays[l].getDirection()[d];
+                dNear += (nodes[near].volume.center(d) - p.origin[d][l]) * dir;
+                dFar += (nodes[far].volume.center(d) - p.origin[d][l]) * dir;
+            }
+            if (dFar < dNear) std::swap(near, far);
+            stack[top++] = {far, active};
+            stack[top++] = {near, active};
+        }
+    }
+
+    template <typename F>
+    void intersectBinary(const Ray &r, const float &tmax, F &&leaf) const {
+        if (nodes.empty()) return;
+        RayQuery q(r);
+        float t;
+        if (!nodes[0].volume.intersect(q, t) || t > tmax) return;
+        int stack[maxDepth + 1];
+        float dist[maxDepth + 1];
+        int top = 0;
+        stack[top] = 0, dist[top++] = t;
+        while (top) {
+            --top;
+            // the closest hit may have moved since this node was pushed
+            if (dist[top] > tmax) continue;
+            int p = stack[top];
+            const bvhNode &node = nodes[p];
+            if (node.count) {
+                leaf(node.offset, node.count);
+                continue;
+            }
+            int near = p + 1, far = node.offset;
+            float tNear, tFar;
+            bool hitNear = nodes[near].volume.intersect(q, tNear) && tNear <= tmax;
+            bool hitFar = nodes[far].volume.intersect(q, tFar) && tFar <= tmax;
+            if (hitNear && hitFar && tFar < tNear)
+                std::swap(near, far), std::swap(tNear, tFar);
+            else if (!hitNear)
+                near = far, tNear = tFar, hitNear = hitFar, hitFar = false;
+            if (hitFar) stack[top] = far, dist[top++] = tFar;
+            if (hitNear) stack[top] = near, dist[top++] = tNear;
+        }
+    }
+};
+
+#endif // BVH_H
@@ -0,0 +1,35 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <vector>
+
+// Accumulation buffer of a progressive render: the sum of the first `samples`
+// samples of every pixel. It is written to disk after every pass, so that an
+// interrupted render resumes from the last finished pass.
+struct Checkpoint {
+    int width = 0, height = 0;
+    int samples = 0;           // samples taken so far by every pixel
+    uint64_t sceneHash = 0;    // of the scene file, so that an edited scene starts over
+    std::vector <double> sum;  // RGB per pixel
+
+    Checkpoint() = default;
+    Checkpoint(int width_, int height_, uint64_t sceneHash_) :
+        width(width_), height(height_), sceneHash(sceneHash_), sum(3 * width_ * height_) {}
+
+    // false if the file is missing, damaged or belongs to another scene or resolution
+    bool load(const char *filename);
+
+    // writes a temporary file and renames it over filename, so that a kill during
+    // the write leaves the previous checkpoint intact
+    bool save(const char *filename) const;
+
+    // FNV-1a hash of the contents of a file
+    static uint64_t hashFile(const char *filename);
+};
+
+#endif // CHECKPOINT_H
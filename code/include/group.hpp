@@ -5,6 +5,7 @@
 #include "object3d.hpp"
 #include "ray.hpp"
 #include "hit.hpp"
+#include "bvh.hpp"
 #include <iostream>
 #include <vector>
 
@@ -16,11 +17,13 @@ public:
     Group() {
         array = nullptr;
         size = 0;
+        useBVH = false;
     }
 
     explicit Group (int num_objects) {
         array = new Object3D *[num_objects];
         size = num_objects;
+        useBVH = false;
     }
 
     ~Group() override {
@@ -31,11 +34,87 @@ public:
 
     bool intersect(const Ray &r, Hit &h, float tmin) override {
         bool ans = false;
-        for (int i = 0; i < size; i++)
+        if (!useBVH) {
+            for (int i = 0; i < size; i++)
+                ans |= array[i]->intersect(r, h, tmin);
+            return ans;
+        }
+        for (int i : unbounded)
             ans |= array[i]->intersect(r, h, tmin);
+        float tmax = h.getT();
+        bvh.intersect(r, tmax, [&] (int first, int count) {
+            for (int i = first; i < first + count; i++)
+                ans |= array[bounded[i]]->intersect(r, h, tmin);
+            tmax = h.getT();
+        });
+        return ans;
+    }
+
+    int intersectPacket(const RayPacket &p, Hit *hits, float tmin, int mask) override {
+        int ans = 0;
+        if (!useBVH) {
+            for (int i = 0; i < size; i++)
+                ans |= array[i]->intersectPacket(p, hits, tmin, mask);
+            return ans;
+        }
+        for (int i : unbounded)
+            ans |= array[i]->intersectPacket(p, hits, tmin, mask);
+        float tmax[RayPacket::maxSize];
+        for (int i = 0; i < RayPacket::maxSize; i++)
+            tmax[i] = i < p.size ? hits[i].getT() : 0;
+        bvh.intersect(p, tmax, mask, [&] (int first, int count, int active) {
+            for (int i = first; i < first + count; i++)
+                ans |= array[bounded[i]]->intersectPacket(p, hits, tmin, active);
+            for (int i = 0; i < p.size; i++)
+                if (active >> i & 1) tmax[i] = hits[i].getT();
+        });
         return ans;
     }
 
+    bool occluded(const Ray &r, float tmin, float tmax) override {
+        if (!useBVH) {
+            for (int i = 0; i < size; i++)
+                if (array[i]->occluded(r, tmin, tmax)) return true;
+            return false;
+        }
+        for (int i : unbounded)
+            if (array[i]->occluded(r, tmin, tmax)) return true;
+        bool found = false;
+        bvh.intersect(r, tmax, [&] (int first, int count) {
+            for (int i = first; i < first + count && !found; i++)
+                found = array[bounded[i]]->occluded(r, tmin, tmax);
+            if (found) tmax = -1;
+        });
+        return found;
+    }
+
+    bool getVolume(volume3d &volume) override {
+        for (int i = 0; i < size; i++)
+            if (!array[i]->getVolume(volume)) return false;
+        return true;
+    }
+
+    // Infinite objects (planes) cannot be bounded; they are kept aside and always tested.
+    void buildBVH() {
+        std::vector <volume3d> volumes;
+        bounded.clear();
+        unbounded.clear();
+        for (int i = 0; i < size; i++) {
+            volume3d volume;
+            if (array[i]->getVolume(volume)) {
+                bounded.push_back(i);
+                volumes.push_back(volume);
+            }
+            else unbounded.push_back(i);
+        }
+        std::vector <int> order;
+        bvh.build(volumes, order);
+        std::vector <int> sorted;
+        for (int i : order) sorted.push_back(bounded[i]);
+        bounded.swap(sorted);
+        useBVH = true;
+    }
+
     void addObject(int index, Object3D *obj) {
         array[index] = obj;
     }
@@ -48,6 +127,10 @@ private:
 
     Object3D **array;
     int size;
+
+    bool useBVH;
+    BVH bvh;
+    std::vector <int> bounded, unbounded;
 };
 
 #endif
@@ -0,0 +1,21 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+const uint64_t fnvOffset = 14695981039346656037ULL;
+
+// FNV-1a over size bytes, continuing from hash so that several pieces form one stream
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t hash = fnvOffset) {
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    return hash;
+}
+
+#endif // HASH_H
@@ -6,7 +6,7 @@
 #define LIGHT_H
 
 #include <Vector3f.h>
-#include <random>
+#include "sampler.hpp"
 #include "object3d.hpp"
 
 class Light {
@@ -64,7 +64,7 @@ private:
 
 class AreaLight : public Light {
 public:
-    virtual Vector3f sampling(std::mt19937_64 &rnd) = 0;
+    virtual Vector3f sampling(Sampler &sampler) = 0;
     virtual bool intersect(const Ray &r, Hit &h, float tmin) = 0;
     virtual Vector3f getColor() = 0;
     virtual float area() = 0;
@@ -100,10 +100,10 @@ public:
         return (x2 - x1) * (y2 - y1);
     }
 
-    Vector3f sampling(std::mt19937_64 &rnd) {
-        std::uniform_real_distribution <float> dist(0, 1);
-        float x = dist(rnd) * (x2 - x1) + x1;
-        float y = dist(rnd) * (y2 - y1) + y1;
+    Vector3f sampling(Sampler &sampler) {
+        Vector2f s = sampler.next2D();
+        float x = s[0] * (x2 - x1) + x1;
+        float y = s[1] * (y2 - y1) + y1;
         if (abs(w) == 1) return Vector3f(z, x, y);
         else if (abs(w) == 2) return Vector3f(y, z, x);
         else return Vector3f(x, y, z);
@@ -149,9 +149,9 @@ public:
         return M_PI * radius * radius;
     }
 
-    Vector3f sampling(std::mt19937_64 &rnd) {
-        std::uniform_real_distribution <float> dist(0, 1);
-        float u = sqrt(dist(rnd)) * radius, v = dist(rnd) * (2 * M_PI);
+    Vector3f sampling(Sampler &sampler) {
+        Vector2f s = sampler.next2D();
+        float u = sqrt(s[0]) * radius, v = s[1] * (2 * M_PI);
         float x0 = x + u * cos(v);
         float y0 = y + u * sin(v);
         if (abs(w) == 1) return Vector3f(z, x0, y0);
@@ -0,0 +1,43 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+// A file mapped read-only into memory for as long as the object lives.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const char *filename) {
+        open(filename);
+    }
+    ~MappedFile() {
+        close();
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // false if the file cannot be opened or mapped; an empty file maps to size() == 0
+    bool open(const char *filename);
+    void close();
+
+    bool isOpen() const {
+        return opened;
+    }
+    const char *data() const {
+        return begin;
+    }
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const char *begin = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+#endif // MAPPED_FILE_H
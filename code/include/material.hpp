@@ -8,7 +8,7 @@
 #include <cassert>
 #include <iostream>
 #include <vecmath.h>
-#include <random>
+#include "sampler.hpp"
 
 #include "ray.hpp"
 #include "hit.hpp"
@@ -17,7 +17,23 @@
 
 class Material {
 public:
+    // lets the integrators dispatch on the material with a switch
+    enum Type {
+        PHONG,
+        REFLECTIVE,
+        REFRACTIVE,
+        FRESNEL,
+        LIGHT,
+        BRDF
+    };
+
+    explicit Material(Type type_) : type(type_) {}
     virtual ~Material() = default;
+
+    Type getType() const {
+        return type;
+    }
+
     virtual Vector3f getColor() = 0;
     virtual Vector3f getColor(float u, float v) = 0;
     virtual Vector3f getColor(Vector2f u) {
@@ -29,6 +45,9 @@ public:
 
 protected:
     Texture *texture;
+
+private:
+    const Type type;
 };
 
 class PhongMaterial : public Material {
@@ -36,7 +55,7 @@ public:
     explicit PhongMaterial(
         const Vector3f &a_color, const Vector3f &d_color,
         const Vector3f &s_color = Vector3f::ZERO, float s = 0) :
-        ambientColor(a_color), diffuseColor(d_color), specularColor(s_color), shininess(s) {
+        Material(PHONG), ambientColor(a_color), diffuseColor(d_color), specularColor(s_color), shininess(s) {
     }
 
     Vector3f getDiffuseColor() const {
@@ -75,7 +94,7 @@ private:
 
 class ReflectiveMaterial : public Material {
 public:
-    explicit ReflectiveMaterial(float r) : rate(r) {}
+    explicit ReflectiveMaterial(float r) : Material(REFLECTIVE), rate(r) {}
 
     Vector3f getColor() {
         return Vector3f(rate);
@@ -91,7 +110,7 @@ private:
 
 class RefractiveMaterial : public Material {
 public:
-    explicit RefractiveMaterial(float n0, float r) : n(n0), rate(r) {}
+    explicit RefractiveMaterial(float n0, float r) : Material(REFRACTIVE), n(n0), rate(r) {}
 
     float getN() {
         return n;
@@ -111,7 +130,7 @@ private:
 
 class FresnelMaterial : public Material {
 public:
-    explicit FresnelMaterial(float n_, float r) : n(n_), rate(r) {
+    explicit FresnelMaterial(float n_, float r) : Material(FRESNEL), n(n_), rate(r) {
         f0 = (1 - n) / (1 + n);
         f0 *= f0;
     }
@@ -140,7 +159,7 @@ private:
 
 class LightMaterial : public Material {
 public:
-    explicit LightMaterial() {}
+    explicit LightMaterial() : Material(LIGHT) {}
 
     Vector3f getColor() {
         return Vector3f(1);
@@ -157,9 +176,11 @@ inline LightMaterial LightMaterial::material = LightMaterial();
 
 class BRDFMaterial : public Material {
 public:
+    BRDFMaterial() : Material(BRDF) {}
+
     virtual Vector3f getBRDF(Vector3f incident, Vector3f normal, Vector3f reflect, Vector3f tangent) = 0;
 
-    virtual Vector3f sampling(Vector3f incident, Vector3f normal, std::mt19937_64 &rnd) = 0;
+    virtual Vector3f sampling(Vector3f incident, Vector3f normal, Sampler &sampler) = 0;
 
     virtual float samplingPDF(Vector3f incident, Vector3f normal, Vector3f reflect) = 0;
     
@@ -192,13 +213,13 @@ public:
         return Vector3f(rho_d0 + rho_s0 * powf(dot, shininess));
     }
 
-    Vector3f sampling(Vector3f incident, Vector3f normal, std::mt19937_64 &rnd) {
-        std::uniform_real_distribution <float> gen(0, 1);
-        if (gen(rnd) * (rho_d + rho_s) < rho_d)
-            return rotate(uniformHemisphere(rnd), normal);
-        float cos_theta = powf(gen(rnd), 1 / (shininess + 1));
+    Vector3f sampling(Vector3f incident, Vector3f normal, Sampler &sampler) {
+        if (sampler.next1D() * (rho_d + rho_s) < rho_d)
+            return rotate(uniformHemisphere(sampler), normal);
+        Vector2f s = sampler.next2D();
+        float cos_theta = powf(s[0], 1 / (shininess + 1));
         float sin_theta = sqrtf(1 - cos_theta * cos_theta);
-        float phi = 2 * M_PI * gen(rnd);
+        float phi = 2 * M_PI * s[1];
         Vector3f h = rotate(Vector3f(sin_theta * cos(phi),
             sin_theta * sin(phi), cos_theta), normal);
         return getReflectDir(incident, h);
@@ -243,10 +264,10 @@ public:
         return rho_d0 + rho_s0 * D * F * G;
     }
 
-    Vector3f sampling(Vector3f incident, Vector3f normal, std::mt19937_64 &rnd) {
-        std::uniform_real_distribution <float> gen(0, 1);
-        float theta = atanf(alpha * sqrt(1 / (1 / gen(rnd) - 1)));
-        float phi = 2 * M_PI * gen(rnd);
+    Vector3f sampling(Vector3f incident, Vector3f normal, Sampler &sampler) {
+        Vector2f s = sampler.next2D();
+        float theta = atanf(alpha * sqrt(1 / (1 / s[0] - 1)));
+        float phi = 2 * M_PI * s[1];
         Vector3f h = rotate(Vector3f(sin(theta) * cos(phi),
             sin(theta) * sin(phi), cos(theta)), normal);
         return getReflectDir(incident, h);
@@ -295,7 +316,7 @@ public:
         return rho_d0 + rho_s0 / sqrtf(ni * nr) * expf(-e);
     }
 
-    Vector3f sampling(Vector3f incident, Vector3f normal, std::mt19937_64 &rnd) {
+    Vector3f sampling(Vector3f incident, Vector3f normal, Sampler &sampler) {
         return Vector3f(0);
     }
 
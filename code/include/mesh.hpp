@@ -5,12 +5,16 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <cstdint>
+#include <cstdio>
 #include <vector>
 #include "object3d.hpp"
 #include "triangle.hpp"
+#include "triangle_soa.hpp"
 #include "Vector2f.h"
 #include "Vector3f.h"
 #include "ray.hpp"
+#include "bvh.hpp"
 
 class Mesh : public Object3D {
 
@@ -20,7 +24,13 @@ public:
         this->material = material;
     }
 
-    Mesh(const char *filename, Material *m);
+    Mesh(const char *filename, Material *m) : Object3D(m) {
+        useVT = useVN = useBVH = false;
+        load(filename);
+    }
+
+    // reads an OBJ file and generates its triangles
+    void load(const char *filename);
 
     struct TriangleIndex {
         TriangleIndex() {
@@ -44,15 +54,27 @@ public:
 
     int getTriangleIndex(int t, int x) {return v_id[t][x];}
 
-    Triangle getTriangle(int i) {
-        assert(i >= 0 && i < triangles.size());
-        return triangles[i];
-    }
-
     void generate();
-    void buildBVH();
-    int intersect_tid(const Ray &r, Hit &h, float tmin);
+    void buildBVH(BVH::Builder builder = BVH::MEDIAN, int width = 2, int threads = 1);
+
+    // A BVH cache file keeps what load and buildBVH produce for an OBJ file: the
+    // packed triangles in leaf order, the texture and normal data shading reads and
+    // the binary BVH nodes, so that a hit restores the mesh without setting up
+    // triangles. It is keyed by the contents of the OBJ file and the BVH settings.
+    static uint64_t cacheKey(const char *filename, BVH::Builder builder, int width);
+    // false, leaving the mesh empty, if the cache is missing, damaged or has another key
+    bool loadCache(const char *cacheFile, uint64_t key, int width);
+    void saveCache(const char *cacheFile, uint64_t key) const;
+    // the same on a cache image in memory or an open file, as scene bundles embed them
+    bool loadCache(const char *data, size_t size, uint64_t key, int width, const char *name);
+    bool writeCache(FILE *file, uint64_t key) const;
+    // Closest triangle with tmin <= t <= (t on entry). Returns its index and
+    // sets t and the barycentrics u, v of vertices 1 and 2, or returns -1.
+    int intersect_tid(const Ray &r, float tmin, float &t, float &u, float &v);
     bool intersect(const Ray &r, Hit &h, float tmin) override;
+    int intersectPacket(const RayPacket &p, Hit *hits, float tmin, int mask) override;
+    bool occluded(const Ray &r, float tmin, float tmax) override;
+    bool getVolume(volume3d &volume) override;
 
 private:
 
@@ -60,98 +82,16 @@ private:
     std::vector <Vector2f> vt;
     std::vector <Vector3f> vn;
     std::vector <TriangleIndex> v_id, vt_id, vn_id;
-    std::vector <Triangle> triangles;
+    TriangleSoA packed; // the triangles, laid out for the SIMD leaf test
 
     bool useVT, useVN;
 
-    struct volume3d {
-        float dmin[3], dmax[3];
-        
-
-        volume3d() {
-            dmin[0] = dmin[1] = dmin[2] = 1e9;
-            dmax[0] = dmax[1] = dmax[2] = -1e9;
-        }
-
-        void merge(Vector3f point) {
-            for (int i = 0; i < 3; i++) {
-                if (point[i] < dmin[i]) dmin[i] = point[i];
-                if (point[i] > dmax[i]) dmax[i] = point[i];
-            }
-        }
-
-        void merge(volume3d b) {
-            for (int i = 0; i < 3; i++) {
-                if (b.dmin[i] < dmin[i]) dmin[i] = b.dmin[i];
-                if (b.dmax[i] > dmax[i]) dmax[i] = b.dmax[i];
-            }
-        }
-
-        void merge(Triangle t) {
-            merge(t.vertices(0));
-            merge(t.vertices(1));
-            merge(t.vertices(2));
-        }
-
-        int getMaxD() {
-            int d = 0;
-            for (int i = 1; i < 3; i++)
-                if (dmax[i] - dmin[i] > dmax[d] - dmin[d]) d = i;
-            return d;
-        }
-
-        float intersect(const Ray &ray) {
-            bool ok = true;
-            for (int i = 0; i < 3 && ok; i++)
-                ok &= (ray.getOrigin()[i] >= dmin[i] && ray.getOrigin()[i] <= dmax[i]);
-            if (ok) return 0;
-            for (int d = 0; d < 3; d++) {
-                if (ray.getDirection()[d] > 0) {
-                    if (ray.getOrigin()[d] > dmax[d]) return -1;
-                }
-                else {
-                    if (ray.getOrigin()[d] < dmin[d]) return -1;
-                }
-            }
-            for (int d = 0; d < 3; d++) {
-                float t;
-                if (ray.getDirection()[d] > 0) {
-                    if (ray.getOrigin()[d] < dmin[d])
-                        t = (dmin[d] - ray.getOrigin()[d]) / ray.getDirection()[d];
-                    else continue;
-                }
-                else if (ray.getDirection()[d] < 0) {
-                    if (ray.getOrigin()[d] > dmax[d])
-                        t = (dmax[d] - ray.getOrigin()[d]) / ray.getDirection()[d];
-                    else continue;
-                }
-                int dx = (d + 1) % 3;
-                float x = ray.getOrigin()[dx] + t * ray.getDirection()[dx];
-                if (x >= dmin[dx] && x <= dmax[dx]) {
-                    dx = (dx + 1) % 3;
-                    x = ray.getOrigin()[dx] + t * ray.getDirection()[dx];
-                    if (x >= dmin[dx] && x <= dmax[dx]) return t;
-                }
-            }
-            return -1;
-        }        
-    };
-
-    struct bvhNode {
-        int son[2], cutd, idl, idr;
-        volume3d volume;
-        bvhNode(int cutd_, int idl_, int idr_) :
-            cutd(cutd_), idl(idl_), idr(idr_) {
-            son[0] = son[1] = -1;
-        }
-    };
-
-    std::vector <bvhNode> bvhTree;
-    std::vector <int> bvhId;
+    BVH bvh;
 
     bool useBVH;
-    
-    void BVHintersect(const Ray &r, Hit &h, float tmin, int p, int &tid);
+
+    // fills h for the closest hit found on triangle tid at t with barycentrics u, v
+    void setHit(const Ray &r, Hit &h, int tid, float t, float u, float v);
 };
 
 #endif
@@ -4,6 +4,7 @@
 #include "ray.hpp"
 #include "hit.hpp"
 #include "material.hpp"
+#include "volume.hpp"
 
 // Base class for all 3d entities.
 class Object3D {
@@ -19,6 +20,28 @@ public:
     // Intersect Ray with this object. If hit, store information in hit structure.
     virtual bool intersect(const Ray &r, Hit &h, float tmin) = 0;
 
+    // Whether anything of this object lies on the ray with tmin <= t <= tmax.
+    // Stops at the first such intersection and computes no shading.
+    virtual bool occluded(const Ray &r, float tmin, float tmax) {
+        Hit h(tmax, nullptr, Vector3f::ZERO, Vector3f::ZERO, false, Vector3f::ZERO);
+        return intersect(r, h, tmin);
+    }
+
+    // Packet version of intersect: rays of mask are tested against hits[i] and the
+    // mask of those that hit is returned. Groups and meshes traverse their BVH once
+    // for the whole packet; other objects test the rays one by one.
+    virtual int intersectPacket(const RayPacket &p, Hit *hits, float tmin, int mask) {
+        int hit = 0;
+        for (int i = 0; i < p.size; i++)
+            if ((mask >> i & 1) && intersect(p.rays[i], hits[i], tmin)) hit |= 1 << i;
+        return hit;
+    }
+
+    // Merge the bounding volume of this object into volume. Returns false if unbounded.
+    virtual bool getVolume(volume3d &volume) {
+        return false;
+    }
+
 protected:
     Material *material;
 };
@@ -30,6 +30,13 @@ public:
         return true;
     }
 
+    bool occluded(const Ray &r, float tmin, float tmax) override {
+        float t = Vector3f::dot(r.getDirection(), normal);
+        if (fabsf(t) < 1e-8) return false;
+        t = (this->d - Vector3f::dot(r.getOrigin(), normal)) / t;
+        return t >= tmin && t <= tmax;
+    }
+
 private:
     Vector3f normal;
     float d;
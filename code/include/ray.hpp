@@ -40,6 +40,43 @@ private:
 
 };
 
+// Ray prepared for repeated box tests: reciprocal direction and its sign bits.
+struct RayQuery {
+    float origin[3], invDir[3];
+    int sign[3];
+
+    explicit RayQuery(const Ray &r) {
+        for (int d = 0; d < 3; d++) {
+            origin[d] = r.getOrigin()[d];
+            invDir[d] = 1 / r.getDirection()[d];
+            sign[d] = (invDir[d] < 0);
+        }
+    }
+};
+
+// Up to maxSize coherent rays traced together through a BVH. The slab test
+// data is stored per axis, so one box is tested against every ray in a loop
+// the compiler vectorizes. Lanes past size repeat the first ray.
+struct RayPacket {
+    static const int maxSize = 16;
+    const Ray *rays;
+    int size;
+    alignas(16) float origin[3][maxSize], invDir[3][maxSize];
+    int sign[3][maxSize];
+
+    RayPacket(const Ray *rays_, int size_) : rays(rays_), size(size_) {
+        assert(size >= 1 && size <= maxSize);
+        for (int i = 0; i < maxSize; i++) {
+            const Ray &r = rays[i < size ? i : 0];
+            for (int d = 0; d < 3; d++) {
+                origin[d][i] = r.getOrigin()[d];
+                invDir[d][i] = 1 / r.getDirection()[d];
+                sign[d][i] = (invDir[d][i] < 0);
+            }
+        }
+    }
+};
+
 inline std::ostream &operator<<(std::ostream &os, const Ray &r) {
     os << "Ray <" << r.getOrigin() << ", " << r.getDirection() << ">";
     return os;
@@ -24,7 +24,6 @@ public:
                 printf("Profile of revSurface must be flat on xy plane.\n");
                 exit(0);
             }
-        buildMesh();
     }
 
     ~RevSurface() override {
@@ -93,15 +92,35 @@ public:
         else {
             float tmin0 = tmin;
             while (true) {
-                Hit h0 = h;
-                int tid = pMesh->intersect_tid(r, h0, tmin0);
+                float t = h.getT(), u, v;
+                int tid = pMesh->intersect_tid(r, tmin0, t, u, v);
                 if (tid == -1) return false;
                 if (intersect_newton(r, h, tmin, tid)) return true;
-                tmin0 = h0.getT() + tmin;
+                tmin0 = t + tmin;
             }
         }
     }
 
+    // the profile lies in the convex hull of its controls, so the controls bound the surface
+    bool getVolume(volume3d &volume) override {
+        float radius = 0, ymin = 1e9, ymax = -1e9;
+        for (const auto &cp : pCurve->getControls()) {
+            radius = std::max(radius, fabsf(cp.x()));
+            ymin = std::min(ymin, cp.y());
+            ymax = std::max(ymax, cp.y());
+        }
+        volume.merge(Vector3f(-radius, ymin, -radius));
+        volume.merge(Vector3f(radius, ymax, radius));
+        return true;
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) override {
+        if (!isNewton)
+            return pMesh->occluded(r, tmin, tmax);
+        return Object3D::occluded(r, tmin, tmax);
+    }
+
+    // triangulates the surface; the scene parser runs it among its loading tasks
     void buildMesh() {
         pMesh = new Mesh(material);
         curvePoints.resize(step1 + 1);
@@ -133,7 +152,7 @@ public:
 
 private:
     Curve *pCurve;
-    Mesh *pMesh;
+    Mesh *pMesh = nullptr;
     int step1, step2;
     bool isNewton;
 
@@ -0,0 +1,161 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <vecmath.h>
+
+// Source of the random numbers of one path. Every sample restarts the stream
+// from (pixel, sample index), so an image does not depend on which thread
+// rendered which pixel or in what order.
+class Sampler {
+public:
+    virtual ~Sampler() = default;
+
+    virtual void startSample(int x, int y, int sample) = 0;
+
+    // uniform in [0, 1)
+    virtual float next1D() = 0;
+
+    virtual Vector2f next2D() {
+        float u = next1D();
+        return Vector2f(u, next1D());
+    }
+
+    // Jumps to dimension d of the current sample, so that e.g. every bounce of a
+    // path starts on the same dimension whatever the previous bounces drew.
+    // Only meaningful to low-discrepancy samplers.
+    virtual void setDimension(int d) {}
+};
+
+// PCG32 (O'Neill, pcg-random.org): 16 bytes of state, one multiply per number.
+class PCGSampler final : public Sampler {
+public:
+    void startSample(int x, int y, int sample) override {
+        // the pixel picks the starting state, the sample index picks the stream;
+        // neighbouring pixels are scrambled apart first
+        seed(mix((uint64_t) (uint32_t) y << 32 | (uint32_t) x), sample);
+    }
+
+    float next1D() override {
+        // 24 random bits, so the result stays below 1 as a float
+        return (nextUInt() >> 8) * 0x1p-24f;
+    }
+
+    uint32_t nextUInt() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+        uint32_t rot = old >> 59;
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+private:
+    uint64_t state = 0, inc = 1;
+
+    // SplitMix64 finalizer
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    void seed(uint64_t initState, uint64_t initSeq) {
+        state = 0;
+        inc = initSeq << 1 | 1;
+        nextUInt();
+        state += initState;
+        nextUInt();
+    }
+};
+
+// Sobol (0, 2)-sequence padded to any number of dimensions with hash-based
+// Owen scrambling (Burley, "Practical Hash-based Owen Scrambling", JCGT 2020).
+// Each next1D / next2D call is one dimension: it shuffles the sample index and
+// scrambles the first two Sobol dimensions with seeds hashed from the pixel and
+// the dimension, so dimensions stay decorrelated and every pixel gets its own
+// scrambling while each dimension keeps its stratification over the samples.
+class SobolSampler final : public Sampler {
+public:
+    void startSample(int x, int y, int sample) override {
+        pixelSeed = hash((uint32_t) x ^ hash((uint32_t) y));
+        index = sample;
+        dimension = 0;
+    }
+
+    float next1D() override {
+        uint32_t seed = dimensionSeed(dimension++);
+        uint32_t i = nestedUniformScramble(index, seed);
+        return toFloat(nestedUniformScramble(reverseBits(i), hash(seed ^ 0x9e3779b9u)));
+    }
+
+    Vector2f next2D() override {
+        uint32_t seed = dimensionSeed(dimension++);
+        uint32_t i = nestedUniformScramble(index, seed);
+        return Vector2f(toFloat(nestedUniformScramble(reverseBits(i), hash(seed ^ 0x9e3779b9u))),
+            toFloat(nestedUniformScramble(sobol1(i), hash(seed ^ 0x7f4a7c15u))));
+    }
+
+    void setDimension(int d) override {
+        dimension = d;
+    }
+
+private:
+    uint32_t pixelSeed = 0, index = 0;
+    int dimension = 0;
+
+    // lowbias32 by Chris Wellons
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32_t dimensionSeed(int d) const {
+        return hash(pixelSeed ^ hash((uint32_t) d + 1));
+    }
+
+    static uint32_t reverseBits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    // Laine-Karras style hash that only lets each bit depend on the bits below it
+    static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    // Owen scrambling of a 32-bit fixed point number in [0, 1)
+    static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+        return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+    }
+
+    // second Sobol dimension; its direction numbers follow v[k] = v[k - 1] ^ (v[k - 1] >> 1)
+    static uint32_t sobol1(uint32_t i) {
+        uint32_t x = 0, v = 0x80000000u;
+        for (; i; i >>= 1, v ^= v >> 1)
+            if (i & 1) x ^= v;
+        return x;
+    }
+
+    static float toFloat(uint32_t x) {
+        return (x >> 8) * 0x1p-24f;
+    }
+};
+
+#endif // SAMPLER_H
@@ -0,0 +1,63 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef SCENE_BUNDLE_H
+#define SCENE_BUNDLE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+
+// A scene bundle (.pa4) packs a scene file with everything it would load: the
+// triangles and BVH of every mesh, in the layout of a .bvhcache, and the bytes
+// of every texture file. Sections are found by type and the file name the scene
+// refers to, and are read in place from the mapped bundle.
+class SceneBundle {
+public:
+    enum SectionType : uint32_t {
+        SCENE = 1,   // the scene text, name ""
+        MESH = 2,    // name: obj_file
+        TEXTURE = 3  // name: texture file
+    };
+
+    struct Section {
+        uint32_t type;
+        std::string name;
+        const char *data;
+        size_t size;
+    };
+
+    // false if the file cannot be mapped or is not a bundle
+    bool open(const char *filename);
+
+    // nullptr if the bundle has no such section
+    const Section *find(SectionType type, const std::string &name) const;
+
+private:
+    MappedFile file;
+    std::vector <Section> sections;
+};
+
+// Writes a bundle section by section to a temporary file that close renames into place.
+class SceneBundleWriter {
+public:
+    ~SceneBundleWriter();
+
+    bool open(const char *filename);
+    // the returned file receives the payload of the section until end is called
+    FILE *begin(SceneBundle::SectionType type, const std::string &name);
+    bool end();
+    bool add(SceneBundle::SectionType type, const std::string &name, const char *data, size_t size);
+    bool close();
+
+private:
+    FILE *file = nullptr;
+    std::string target, temp;
+    long sectionStart = 0;
+    bool ok = false;
+};
+
+#endif // SCENE_BUNDLE_H
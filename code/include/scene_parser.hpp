@@ -6,14 +6,20 @@
 #define SCENE_PARSER_H
 
 #include <cassert>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 #include <vecmath.h>
 
 class Camera;
 class Light;
+class AreaLight;
 class Texture;
 class Material;
 class Object3D;
 class Group;
+class SceneBundle;
 class Sphere;
 class Plane;
 class Triangle;
@@ -44,6 +50,14 @@ public:
         return omp_threads;
     }
 
+    int getTileSize() {
+        return tile_size;
+    }
+
+    int getTileOrder() {
+        return tile_order;
+    }
+
     Vector3f getBackgroundColor() const {
         return background_color;
     }
@@ -52,6 +66,18 @@ public:
         return sampling;
     }
 
+    int getIntegrator() {
+        return integrator;
+    }
+
+    int getSamplerType() {
+        return sampler_type;
+    }
+
+    int getPacketSize() {
+        return packet_size;
+    }
+
     int getAntialias() {
         return antialias;
     }
@@ -60,6 +86,30 @@ public:
         return SPP;
     }
 
+    bool getAdaptive() {
+        return adaptive;
+    }
+
+    int getMinSPP() {
+        return minSPP;
+    }
+
+    int getMaxSPP() {
+        return maxSPP > 0 ? maxSPP : SPP;
+    }
+
+    float getThreshold() {
+        return threshold;
+    }
+
+    bool getHeatmap() {
+        return heatmap;
+    }
+
+    bool getProgressive() {
+        return progressive;
+    }
+
     float getGamma() {
         return gamma;
     }
@@ -68,6 +118,14 @@ public:
         return rrProb;
     }
 
+    int getMaxDepth() {
+        return maxDepth;
+    }
+
+    int getrrDepth() {
+        return rrDepth;
+    }
+
     float getTmin() {
         return tmin;
     }
@@ -81,6 +139,16 @@ public:
         return lights[i];
     }
 
+    // the area lights among the lights, in scene order, for next event estimation
+    int getNumAreaLights() const {
+        return num_area_lights;
+    }
+
+    AreaLight *getAreaLight(int i) const {
+        assert(i >= 0 && i < num_area_lights);
+        return area_lights[i];
+    }
+
     int getNumTextures() const {
         return num_textures;
     }
@@ -103,6 +171,14 @@ public:
         return group;
     }
 
+    // Packs the scene file with the meshes it loaded and its texture files into a
+    // scene bundle (.pa4), which the constructor then reads instead of a .txt.
+    bool saveBundle(const char *filename) const;
+
+    // replaces the camera with the PerspectiveCamera of a scene file holding only that,
+    // so that one bundle renders from many views
+    bool loadCamera(const char *filename);
+
 private:
 
     void parseFile();
@@ -111,8 +187,8 @@ private:
     void parseLights();
     Light *parsePointLight();
     Light *parseDirectionalLight();
-    Light *parseRectLight();
-    Light *parseCircleLight();
+    AreaLight *parseRectLight();
+    AreaLight *parseCircleLight();
     void parseTextures();
     void parseMaterials();
     Material *parsePhongMaterial();
@@ -132,6 +208,7 @@ private:
     Curve *parseBsplineCurve();
     RevSurface *parseRevSurface();
     Transform *parseTransform();
+    void runLoadTasks();
 
     int getToken(char token[MAX_PARSER_TOKEN_LENGTH]);
 
@@ -144,6 +221,13 @@ private:
     Camera *camera;
     int model; // 0: Whitted 1: Monte Carlo
     int omp_threads;
+    int tile_size;
+    int tile_order;
+    /*
+        0 = scanline
+        1 = Hilbert
+        2 = center-out
+    */
     Vector3f background_color; // for Whitted
     int sampling; // for Monte Carlo
     /*
@@ -154,6 +238,9 @@ private:
         3 = NEE-BRDF
         4 = MIS
     */
+    int integrator; // for Monte Carlo, 0 = depth-first paths 1 = wavefront
+    int sampler_type; // for Monte Carlo, 0 = PCG32 1 = Owen-scrambled Sobol
+    int packet_size; // for Whitted-Style, primary rays traced together: 1 4 8 16
     int antialias;
     /*
         0 = none
@@ -162,17 +249,37 @@ private:
         3 = Hammersley + FAXX
     */
     int SPP; // for Monte Carlo
+    // for Monte Carlo: adaptive sampling stops a pixel between minSPP and maxSPP
+    // (SPP if unset) once the relative standard error falls below threshold
+    bool adaptive;
+    int minSPP, maxSPP;
+    float threshold;
+    bool heatmap; // also save the number of samples per pixel
+    bool progressive; // for Monte Carlo, render passes of 1, 2, 4 ... samples with a checkpoint
     float gamma;
     float rrProb; // for Monte Carlo
+    int maxDepth; // for Monte Carlo, bounces after which a path ends
+    int rrDepth; // for Monte Carlo, bounces before Russian roulette starts
     float tmin;
     int num_lights;
     Light **lights;
+    int num_area_lights;
+    AreaLight **area_lights;
     int num_textures;
     int num_materials;
     Texture **textures;
     Material **materials;
     Material *current_material;
     Group *group;
+    // mesh files, revolved surfaces and their BVHs, queued while parsing and
+    // built in parallel once the whole scene is read
+    std::vector <std::function <void()>> load_tasks;
+    std::vector <Group *> groups; // in the order they close, so nested groups come first
+    // what saveBundle packs: the scene file, the textures and the meshes by bundle section
+    std::string scene_file;
+    std::vector <std::string> texture_files;
+    std::vector <std::pair <std::string, Mesh *>> bundle_meshes;
+    SceneBundle *bundle; // while a bundle is being read
 };
 
 #endif // SCENE_PARSER_H
@@ -0,0 +1,66 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <omp.h>
+
+// Splits the image into square tiles and renders them on a team of OpenMP
+// threads. Every worker owns a deque of tiles dealt out in the chosen order,
+// takes work from its front and, once empty, steals from the back of another.
+class TileScheduler {
+public:
+    enum Order {
+        SCANLINE,
+        HILBERT,   // along a Hilbert curve over the tile grid
+        CENTER_OUT // nearest to the image center first
+    };
+
+    struct tile {
+        int x0, y0, x1, y1; // pixels [x0, x1) x [y0, y1)
+        int id;             // scanline index of the tile, independent of the order
+    };
+
+    TileScheduler(int width, int height, int tileSize, Order order);
+
+    int getNumTiles() const {
+        return tiles.size();
+    }
+
+    // Calls render(t, worker) once for every tile t on threads workers.
+    // worker is the thread number, so callers keep per-thread state in an array.
+    template <typename F>
+    void run(int threads, F &&render) {
+        if (threads < 1) threads = 1;
+        std::vector <worker> workers(threads);
+        int n = tiles.size();
+        // contiguous runs of the order, so each worker starts on neighbouring tiles
+        for (int k = 0; k < threads; k++)
+            for (int i = (long long) n * k / threads; i < (long long) n * (k + 1) / threads; i++)
+                workers[k].tiles.push_back(tiles[i]);
+        #pragma omp parallel num_threads(threads)
+        {
+            int self = omp_get_thread_num();
+            tile t;
+            while (next(workers, self, t))
+                render(t, self);
+        }
+    }
+
+private:
+    struct worker {
+        std::deque <tile> tiles;
+        std::mutex lock;
+    };
+
+    std::vector <tile> tiles;
+
+    static bool next(std::vector <worker> &workers, int self, tile &t);
+};
+
+#endif // SCHEDULER_H
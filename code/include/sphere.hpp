@@ -6,6 +6,7 @@
 #define SPHERE_H
 
 #include "object3d.hpp"
+#include "vec3.hpp"
 #include <vecmath.h>
 #include <cmath>
 
@@ -13,12 +14,12 @@ class Sphere : public Object3D {
 public:
     Sphere() {
         // unit ball at the center
-        center = Vector3f(0., 0., 0.);
+        center = Vec3(0, 0, 0);
         radius = 1;
     }
 
     Sphere(const Vector3f &center, float radius, Material *material) : Object3D(material) {
-        this->center = center;
+        this->center = Vec3(center);
         this->radius = radius;
         this->squaredRadius = radius * radius;
     }
@@ -26,9 +27,9 @@ public:
     ~Sphere() override = default;
 
     bool intersect(const Ray &r, Hit &h, float tmin) override {
-        Vector3f o = r.pointAtParameter(tmin);
-        Vector3f l = center - o;
-        float t = Vector3f::dot(l, r.getDirection());
+        Vec3 dir(r.getDirection());
+        Vec3 l = center - (Vec3(r.getOrigin()) + dir * tmin);
+        float t = Vec3::dot(l, dir);
         float d = l.squaredLength() - t * t;
         bool isFront = (l.squaredLength() > squaredRadius);
         if (isFront) {
@@ -38,8 +39,8 @@ public:
         else t += sqrtf(squaredRadius - d);
         t += tmin;
         if (t > h.getT()) return false;
-        Vector3f p = r.pointAtParameter(t);
-        Vector3f normal = (p - center).normalized();
+        Vec3 p = Vec3(r.getOrigin()) + dir * t;
+        Vec3 normal = (p - center).normalized();
         h.set(t, material, isFront ? normal : -normal,
             material->useTexture() && isFront ? material->getColor(
             atan2f(p[1] - center[1], p[0] - center[0]) / (2 * M_PI) + 0.5,
@@ -48,8 +49,27 @@ public:
         return true;
     }
 
+    bool occluded(const Ray &r, float tmin, float tmax) override {
+        Vec3 dir(r.getDirection());
+        Vec3 l = center - (Vec3(r.getOrigin()) + dir * tmin);
+        float t = Vec3::dot(l, dir);
+        float d = l.squaredLength() - t * t;
+        if (l.squaredLength() > squaredRadius) {
+            if (t < 0 || d > squaredRadius) return false;
+            t -= sqrtf(squaredRadius - d);
+        }
+        else t += sqrtf(squaredRadius - d);
+        return t + tmin <= tmax;
+    }
+
+    bool getVolume(volume3d &volume) override {
+        volume.merge(Vector3f(center - Vec3(radius)));
+        volume.merge(Vector3f(center + Vec3(radius)));
+        return true;
+    }
+
 private:
-    Vector3f center;
+    Vec3 center;
     float radius, squaredRadius;
 };
 
@@ -7,11 +7,15 @@
 class Texture {
 public:
 	void set(const char *filename);
+	// from the bytes of an image file, as kept in a scene bundle; name is for messages
+	void set(const char *name, const char *data, size_t size);
 	Vector3f getColor(float u, float v);
 	void gammaCorrection(float gamma);
 
 private:
 	Image *image;
+	void set(const char *name, unsigned char *data, int channels);
+
 	int width, height;
 };
 
@@ -1,8 +1,38 @@
-#include <random>
+#include "sampler.hpp"
 #include <Vector3f.h>
 #include "ray.hpp"
 #include "scene_parser.hpp"
 #include "light.hpp"
 
-Vector3f tracingMC(Ray ray, SceneParser &Parser, std::mt19937_64 &rnd, AreaLight *&pLight);
-Vector3f tracingMC(int x, int y, SceneParser &Parser);
+// One bounce of a path, split into the steps that tracingMC and the wavefront
+// integrator share, so that both draw the same random numbers for a sample.
+
+// sampler dimensions of a bounce: Russian roulette, up to three for scattering,
+// then one per area light
+const int scatterDims = 4;
+bool gamble(Sampler &sampler, float rrProb);
+// closest hit among the scene and the area lights; pLight is the light hit from the front
+bool intersectScene(const Ray &ray, SceneParser &Parser, Hit &hit, AreaLight *&pLight);
+// weight of the emission at a light hit, for a ray sampled with pdf; with mis, against light sampling
+float emissionWeight(const Ray &ray, const Hit &hit, AreaLight *pLight, float pdf, bool mis);
+// Russian roulette at bounce depth; false if the path ends
+bool roulette(int depth, Vector3f &throughput, SceneParser &Parser, Sampler &sampler);
+// continues ray from its hit into next, updating throughput and the pdf of next; false if the path ends
+bool scatter(const Ray &ray, const Hit &hit, SceneParser &Parser, Sampler &sampler,
+    Ray &next, Vector3f &throughput, float &pdf, bool &mis);
+// For a BRDF hit: shadow ray to a point sampled on area light l, to be tested up to tmax.
+// contribution is what the light adds if nothing is in the way; false if it cannot add anything.
+bool sampleLight(int l, const Ray &ray, const Hit &hit, SceneParser &Parser, Sampler &sampler,
+    Ray &shadow, float &tmax, Vector3f &contribution);
+// whether the scene or another light than l blocks the shadow ray before tmax
+bool shadowed(const Ray &shadow, float tmax, int l, SceneParser &Parser);
+// primary ray of the k-th sample of pixel (x, y); restarts sampler for that sample
+Ray cameraRay(int x, int y, int k, SceneParser &Parser, Sampler &sampler);
+
+// iterative path tracer: carries the path throughput instead of recursing per bounce
+Vector3f tracingMC(Ray ray, SceneParser &Parser, Sampler &sampler);
+// the k-th sample of pixel (x, y); the same k always gives the same value
+Vector3f tracingMC(int x, int y, int k, SceneParser &Parser, Sampler &sampler);
+// sampler is reused by the calling thread and restarted for every sample;
+// samples returns how many were taken, fewer than maxSPP once an adaptive pixel converged
+Vector3f tracingMC(int x, int y, SceneParser &Parser, Sampler &sampler, int &samples);
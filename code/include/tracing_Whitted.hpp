@@ -4,3 +4,5 @@
 
 Vector3f tracingWhitted(Ray ray, SceneParser &Parser, Vector3f rate);
 Vector3f tracingWhitted(int x, int y, SceneParser &Parser);
+// n <= RayPacket::maxSize pixels whose primary rays are traced as one packet
+void tracingWhitted(const int *x, const int *y, int n, SceneParser &Parser, Vector3f *colors);
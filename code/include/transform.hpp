@@ -6,6 +6,8 @@
 #define TRANSFORM_H
 
 #include <vecmath.h>
+#include <new>
+#include <type_traits>
 #include "object3d.hpp"
 
 // transforms a 3D point using a matrix, returning a 3D point
@@ -37,15 +39,56 @@ public:
         trDirection = trDirection * invNorm;
 
         Ray tr(trSource, trDirection);
-        bool inter = o->intersect(tr, h, tmin);
+        // the object works in its own length unit, so scale the current closest hit to it
+        Hit hl(h.getT() / invNorm, nullptr, Vector3f::ZERO, Vector3f::ZERO, false, Vector3f::ZERO);
+        bool inter = o->intersect(tr, hl, tmin);
         if (inter) {
-            h.set(h.getT() * invNorm, h.getMaterial(), transformDirection(
-                transform.transposed(), h.getNormal()).normalized(), h.getColor(), h.getIsFront(),
-                transformDirection(transform.transposed(), h.getTangent()).normalized());
+            h.set(hl.getT() * invNorm, hl.getMaterial(), transformDirection(
+                transform.transposed(), hl.getNormal()).normalized(), hl.getColor(), hl.getIsFront(),
+                transformDirection(transform.transposed(), hl.getTangent()).normalized());
         }
         return inter;
     }
 
+    // an affine map keeps the packet coherent, so it is traced as one in object space
+    int intersectPacket(const RayPacket &p, Hit *hits, float tmin, int mask) override {
+        // Ray has no default constructor, so the local rays are placed into raw stack storage
+        static_assert(std::is_trivially_destructible <Ray>::value, "local rays are never destroyed");
+        alignas(Ray) unsigned char storage[RayPacket::maxSize * sizeof(Ray)];
+        Ray *rays = reinterpret_cast <Ray *> (storage);
+        float invNorm[RayPacket::maxSize];
+        Hit local[RayPacket::maxSize];
+        for (int i = 0; i < p.size; i++) {
+            Vector3f trDirection = transformDirection(transform, p.rays[i].getDirection());
+            invNorm[i] = 1. / trDirection.length();
+            new (rays + i) Ray(transformPoint(transform, p.rays[i].getOrigin()), trDirection * invNorm[i]);
+            local[i] = Hit(hits[i].getT() / invNorm[i], nullptr, Vector3f::ZERO, Vector3f::ZERO, false, Vector3f::ZERO);
+        }
+        int hit = o->intersectPacket(RayPacket(rays, p.size), local, tmin, mask);
+        for (int i = 0; i < p.size; i++)
+            if (hit >> i & 1)
+                hits[i].set(local[i].getT() * invNorm[i], local[i].getMaterial(), transformDirection(
+                    transform.transposed(), local[i].getNormal()).normalized(), local[i].getColor(),
+                    local[i].getIsFront(), transformDirection(transform.transposed(), local[i].getTangent()).normalized());
+        return hit;
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) override {
+        Vector3f trSource = transformPoint(transform, r.getOrigin());
+        Vector3f trDirection = transformDirection(transform, r.getDirection());
+        float invNorm = 1. / trDirection.length();
+        return o->occluded(Ray(trSource, trDirection * invNorm), tmin, tmax / invNorm);
+    }
+
+    bool getVolume(volume3d &volume) override {
+        volume3d local;
+        if (!o->getVolume(local)) return false;
+        Matrix4f inv = transform.inverse();
+        for (int k = 0; k < 8; k++)
+            volume.merge(transformPoint(inv, local.corner(k)));
+        return true;
+    }
+
 private:
     Object3D *o; //un-transformed object
     Matrix4f transform;
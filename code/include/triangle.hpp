@@ -6,6 +6,7 @@
 #define TRIANGLE_H
 
 #include "object3d.hpp"
+#include "vec3.hpp"
 #include <vecmath.h>
 #include <cmath>
 #include <iostream>
@@ -17,59 +18,76 @@ public:
 	Triangle() = delete;
 
 	Triangle(const Vector3f& a, const Vector3f& b, const Vector3f& c, Material* m) : Object3D(m) {
-		A = a, edge1 = b - a, edge2 = c - a;
-		normal = Vector3f::cross(edge1, edge2).normalized();
+		A = Vec3(a), edge1 = Vec3(b) - A, edge2 = Vec3(c) - A;
+		normal = Vec3::cross(edge1, edge2).normalized();
 	}
 
 	bool intersect(const Ray& ray,  Hit& h, float tmin) override {
-		Vector3f p = Vector3f::cross(ray.getDirection(), edge2);
-		float a = Vector3f::dot(edge1, p);
+		float t = h.getT();
+		if (!intersect(ray, tmin, t)) return false;
+		setHit(ray, h, t);
+		return true;
+	}
+
+	bool occluded(const Ray& ray, float tmin, float tmax) override {
+		return intersect(ray, tmin, tmax);
+	}
+
+	// Möller–Trumbore: on a hit with tmin <= t <= tmax, stores t in tmax
+	bool intersect(const Ray& ray, float tmin, float &tmax) {
+		Vec3 dir(ray.getDirection());
+		Vec3 p = Vec3::cross(dir, edge2);
+		float a = Vec3::dot(edge1, p);
 		if (fabsf(a) < 1e-8) return false;
 		float f = 1 / a;
-		Vector3f s = ray.getOrigin() - A;
-		float u = f * Vector3f::dot(s, p);
+		Vec3 s = Vec3(ray.getOrigin()) - A;
+		float u = f * Vec3::dot(s, p);
 		if (u < 0 || u > 1) return false;
-		Vector3f q = Vector3f::cross(s, edge1);
-		float v = f * Vector3f::dot(ray.getDirection(), q);
+		Vec3 q = Vec3::cross(s, edge1);
+		float v = f * Vec3::dot(dir, q);
 		if (v < 0 || u + v > 1) return false;
-		float t = f * Vector3f::dot(q, edge2);
-		if (t < tmin || t > h.getT()) return false;
-		float dot = Vector3f::dot(ray.getDirection(), normal);
+		float t = f * Vec3::dot(q, edge2);
+		if (t < tmin || t > tmax) return false;
+		tmax = t;
+		return true;
+	}
+
+	// fill h for a hit at distance t found by this or a packed test
+	void setHit(const Ray& ray, Hit& h, float t) {
+		float dot = Vec3::dot(Vec3(ray.getDirection()), normal);
 		h.set(t, material, dot < 0 ? normal : -normal,
 			material->getColor(), dot < 0, Vector3f::ZERO);
-		return true;
 	}
 
-	Vector3f getWeight(const Ray& ray,  Hit& hit) {
-		Vector3f h = Vector3f::cross(ray.getDirection(), edge2);
-		float a = Vector3f::dot(edge1, h);
-		float f = 1 / a;
-		Vector3f s = ray.getOrigin() - A;
-		float u = f * Vector3f::dot(s, h);
-		Vector3f q = Vector3f::cross(s, edge1);
-		float v = f * Vector3f::dot(ray.getDirection(), q);
-		return Vector3f(1 - u - v, u, v);
+	bool getVolume(volume3d &volume) override {
+		volume.merge(Vector3f(A));
+		volume.merge(Vector3f(A + edge1));
+		volume.merge(Vector3f(A + edge2));
+		return true;
 	}
 
-	Vector3f &getNormal() {return normal;}
+	const Vec3 &getNormal() const {return normal;}
+	const Vec3 &getA() const {return A;}
+	const Vec3 &getEdge1() const {return edge1;}
+	const Vec3 &getEdge2() const {return edge2;}
 	
-	Vector3f vertices(int x) {
+	Vec3 vertices(int x) const {
 		if (x == 0) return A;
 		if (x == 1) return A + edge1;
 		return A + edge2;
 	}
 
-	float dmin(int x) {
+	float dmin(int x) const {
 		return A[x] + std::min((float)0, std::min(edge1[x], edge2[x]));
 	}
 
-	float dmax(int x) {
+	float dmax(int x) const {
 		return A[x] + std::max((float)0, std::max(edge1[x], edge2[x]));
 	}
 
 private:
-	Vector3f normal;
-	Vector3f A, edge1, edge2;
+	Vec3 normal;
+	Vec3 A, edge1, edge2;
 };
 
 #endif //TRIANGLE_H
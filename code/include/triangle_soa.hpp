@@ -0,0 +1,79 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef TRIANGLE_SOA_H
+#define TRIANGLE_SOA_H
+
+#include <vector>
+#include "vec3.hpp"
+#include "volume.hpp"
+#include "ray.hpp"
+
+// Triangles of a mesh split by component (A, edge1, edge2), so that one
+// Möller–Trumbore test runs on 8 triangles at once with AVX2.
+class TriangleSoA {
+public:
+    void resize(int n);
+    // triangle i becomes (a, b, c), stored as A = a, edge1 = b - a, edge2 = c - a like Triangle
+    void set(int i, const Vector3f &a, const Vector3f &b, const Vector3f &c);
+    // triangle i becomes triangle order[i]
+    void permute(const std::vector <int> &order);
+
+    int getSize() const {
+        return size;
+    }
+
+    Vec3 getA(int i) const {
+        return Vec3(comp[AX][i], comp[AY][i], comp[AZ][i]);
+    }
+    Vec3 getEdge1(int i) const {
+        return Vec3(comp[E1X][i], comp[E1Y][i], comp[E1Z][i]);
+    }
+    Vec3 getEdge2(int i) const {
+        return Vec3(comp[E2X][i], comp[E2Y][i], comp[E2Z][i]);
+    }
+
+    // the same normal and bounds as the Triangle made from the same vertices
+    Vec3 getNormal(int i) const {
+        return Vec3::cross(getEdge1(i), getEdge2(i)).normalized();
+    }
+    void getVolume(int i, volume3d &volume) const {
+        Vec3 A = getA(i);
+        volume.merge(Vector3f(A));
+        volume.merge(Vector3f(A + getEdge1(i)));
+        volume.merge(Vector3f(A + getEdge2(i)));
+    }
+
+    // Nearest hit among triangles [first, first + count) with tmin <= t <= tmax.
+    // Returns its index and stores the distance in tmax and the barycentrics
+    // of vertices 1 and 2 in u and v, or returns -1 and leaves them untouched.
+    int intersect(const Ray &r, int first, int count, float tmin, float &tmax, float &u, float &v) const;
+
+    // The components A.x, A.y, A.z, edge1.x, ..., edge2.z, each getSize() floats
+    // followed by padding; a BVH cache stores and restores them as they are.
+    static const int components = 9;
+    float *component(int c) {
+        return comp[c].data();
+    }
+    const float *component(int c) const {
+        return comp[c].data();
+    }
+
+    size_t memory() const {
+        return sizeof(float) * components * (size + lanes);
+    }
+
+private:
+    static const int lanes = 8;
+
+    enum {AX, AY, AZ, E1X, E1Y, E1Z, E2X, E2Y, E2Z};
+
+    // every component is padded by a full block so that loads may run past the end
+    std::vector <float> comp[components];
+    int size = 0;
+
+    int intersectScalar(const Ray &r, int first, int count, float tmin, float &tmax, float &u, float &v) const;
+};
+
+#endif // TRIANGLE_SOA_H
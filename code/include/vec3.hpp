@@ -0,0 +1,86 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef VEC3_H
+#define VEC3_H
+
+#include <cmath>
+#include <cstring>
+#include <Vector3f.h>
+
+// Header-only 3D vector for the intersection and sampling hot paths. Every
+// operation inlines, unlike Vector3f whose operators live in the vecmath
+// library; Vector3f stays the type of the parser, the scene and Hit.
+struct Vec3 {
+    float x, y, z;
+
+    constexpr Vec3() : x(0), y(0), z(0) {}
+    constexpr explicit Vec3(float f) : x(f), y(f), z(f) {}
+    constexpr Vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+
+    // Vector3f holds exactly three floats, so a copy avoids its out-of-line accessors
+    explicit Vec3(const Vector3f &v) {
+        static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f layout changed");
+        std::memcpy(this, &v, sizeof(Vec3));
+    }
+
+    operator Vector3f() const {
+        return Vector3f(x, y, z);
+    }
+
+    constexpr float operator[](int i) const {
+        return i == 0 ? x : (i == 1 ? y : z);
+    }
+
+    constexpr Vec3 operator-() const {
+        return Vec3(-x, -y, -z);
+    }
+
+    constexpr float squaredLength() const {
+        return x * x + y * y + z * z;
+    }
+
+    float length() const {
+        return sqrtf(x * x + y * y + z * z);
+    }
+
+    Vec3 normalized() const {
+        float norm = length();
+        return Vec3(x / norm, y / norm, z / norm);
+    }
+
+    static constexpr float dot(const Vec3 &a, const Vec3 &b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    static constexpr Vec3 cross(const Vec3 &a, const Vec3 &b) {
+        return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+};
+
+constexpr Vec3 operator+(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+constexpr Vec3 operator-(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+constexpr Vec3 operator*(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+constexpr Vec3 operator*(const Vec3 &a, float f) {
+    return Vec3(a.x * f, a.y * f, a.z * f);
+}
+
+constexpr Vec3 operator*(float f, const Vec3 &a) {
+    return Vec3(a.x * f, a.y * f, a.z * f);
+}
+
+constexpr Vec3 operator/(const Vec3 &a, float f) {
+    return Vec3(a.x / f, a.y / f, a.z / f);
+}
+
+#endif // VEC3_H
@@ -0,0 +1,71 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include <vecmath.h>
+#include <cmath>
+#include "ray.hpp"
+
+// Axis-aligned bounding box.
+struct volume3d {
+    float dmin[3], dmax[3];
+
+    volume3d() {
+        dmin[0] = dmin[1] = dmin[2] = 1e9;
+        dmax[0] = dmax[1] = dmax[2] = -1e9;
+    }
+
+    void merge(const Vector3f &point) {
+        for (int i = 0; i < 3; i++) {
+            if (point[i] < dmin[i]) dmin[i] = point[i];
+            if (point[i] > dmax[i]) dmax[i] = point[i];
+        }
+    }
+
+    void merge(const volume3d &b) {
+        for (int i = 0; i < 3; i++) {
+            if (b.dmin[i] < dmin[i]) dmin[i] = b.dmin[i];
+            if (b.dmax[i] > dmax[i]) dmax[i] = b.dmax[i];
+        }
+    }
+
+    Vector3f corner(int k) const {
+        return Vector3f(k & 1 ? dmax[0] : dmin[0],
+            k & 2 ? dmax[1] : dmin[1], k & 4 ? dmax[2] : dmin[2]);
+    }
+
+    float center(int d) const {
+        return (dmin[d] + dmax[d]) / 2;
+    }
+
+    float area() const {
+        if (dmin[0] > dmax[0]) return 0;
+        float x = dmax[0] - dmin[0], y = dmax[1] - dmin[1], z = dmax[2] - dmin[2];
+        return 2 * (x * y + y * z + z * x);
+    }
+
+    int getMaxD() const {
+        int d = 0;
+        for (int i = 1; i < 3; i++)
+            if (dmax[i] - dmin[i] > dmax[d] - dmin[d]) d = i;
+        return d;
+    }
+
+    // Slab test. On a hit, tnear is the entry distance (0 if the origin is inside).
+    bool intersect(const RayQuery &q, float &tnear) const {
+        const float *bounds[2] = {dmin, dmax};
+        float tfar = 1e38;
+        tnear = 0;
+        for (int d = 0; d < 3; d++) {
+            // fmaxf/fminf drop the NaN of 0 * inf on an axis-parallel ray
+            tnear = fmaxf(tnear, (bounds[q.sign[d]][d] - q.origin[d]) * q.invDir[d]);
+            tfar = fminf(tfar, (bounds[q.sign[d] ^ 1][d] - q.origin[d]) * q.invDir[d]);
+        }
+        return tnear <= tfar;
+    }
+};
+
+#endif // VOLUME_H
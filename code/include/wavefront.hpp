@@ -0,0 +1,75 @@
+/*
+原创性：独立实现
+*/
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include "scene_parser.hpp"
+#include "scheduler.hpp"
+#include "sampler.hpp"
+#include "hit.hpp"
+
+// Breadth-first Monte Carlo path tracer. The paths of a tile advance one bounce
+// at a time through the stages generate, intersect, shade, shadow and compact,
+// each a loop over a queue of rays stored as structure of arrays. Between the
+// stages rays are sorted by direction octant and hits by material, so that every
+// loop runs over similar work. Each path owns a copy of the sampler and draws the
+// same numbers as in tracingMC, so both integrators render the same image.
+class WavefrontIntegrator {
+public:
+    explicit WavefrontIntegrator(SceneParser &Parser);
+
+    // adds the sum of samples [first, last) of every pixel (x, y) of t to sum[3 * (y * width + x)]
+    void render(const TileScheduler::tile &t, int first, int last, double *sum);
+
+private:
+    struct RayQueue {
+        std::vector <float> origin[3], direction[3];
+        std::vector <int> path;
+
+        int size() const {
+            return path.size();
+        }
+
+        void clear();
+        void push(const Ray &r, int p);
+        Ray get(int j) const;
+        // entry j of this queue becomes entry order[j] of from
+        void gather(const RayQueue &from, const std::vector <int> &order);
+    };
+
+    // rays towards points sampled on the area lights, with what they add if unoccluded
+    struct ShadowQueue : RayQueue {
+        std::vector <float> tmax, contribution[3];
+        std::vector <int> light;
+
+        void clear();
+        void push(const Ray &r, int p, float t, int l, const Vector3f &c);
+    };
+
+    SceneParser &Parser;
+    int width;
+
+    // path state, indexed by path
+    std::vector <float> throughput[3], radiance[3], pdf;
+    std::vector <char> mis;
+    // weight of the light sampled at the current bounce and the sum of its unoccluded shares
+    std::vector <float> lightWeight[3], lightSum[3];
+    std::vector <PCGSampler> pcg;
+    std::vector <SobolSampler> sobol;
+
+    // queues of the current bounce, indexed by queue entry
+    RayQueue rays, next;
+    ShadowQueue shadows;
+    std::vector <Hit> hits;
+    std::vector <AreaLight *> hitLights;
+    std::vector <char> hitted, visible;
+    std::vector <int> order, sampled;
+
+    template <typename S>
+    void renderWave(const TileScheduler::tile &t, int first, int last, std::vector <S> &samplers);
+};
+
+#endif // WAVEFRONT_H
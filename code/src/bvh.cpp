@@ -0,0 +1,458 @@
+/*
+原创性：独立实现
+*/
+
+#include "bvh.hpp"
+#include "hash.hpp"
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <map>
+#include <cmath>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    const int medianMaxLeaf = 3;
+    const int sahBins = 16;
+    const int sahMaxLeaf = 8;
+    const float sahTraversalCost = 1;
+    const float sahIntersectCost = 1;
+    // ranges at least this large are bounded, binned and partitioned in chunks,
+    // which run as tasks when the build has threads
+    const int chunkSize = 1 << 13;
+    const int chunkedRange = 2 * chunkSize;
+    // smallest range whose children are built as separate tasks
+    const int taskGrain = 1 << 12;
+
+    // runs f(chunk, first, last) over the chunks of [l, r) as tasks and waits for all of them
+    template <typename F>
+    void forChunks(int l, int r, F &&f) {
+        int chunks = (r - l + chunkSize - 1) / chunkSize;
+        for (int c = 0; c < chunks; c++) {
+            #pragma omp task default(shared) firstprivate(c)
+            f(c, l + c * chunkSize, std::min(r, l + (c + 1) * chunkSize));
+        }
+        #pragma omp taskwait
+    }
+
+    int numChunks(int l, int r) {
+        return (r - l + chunkSize - 1) / chunkSize;
+    }
+
+    Vector3f center(const volume3d &volume) {
+        return Vector3f(volume.center(0), volume.center(1), volume.center(2));
+    }
+
+    // bounds of the primitives id[l, r) and, if centers is set, of their centers
+    void bound(const std::vector <volume3d> &volumes, const std::vector <int> &id, int l, int r,
+        volume3d &volume, volume3d *centers) {
+        if (r - l < chunkedRange) {
+            for (int j = l; j < r; j++) {
+                volume.merge(volumes[id[j]]);
+                if (centers) centers->merge(center(volumes[id[j]]));
+            }
+            return;
+        }
+        std::vector <volume3d> chunkVolume(numChunks(l, r)), chunkCenters(numChunks(l, r));
+        forChunks(l, r, [&] (int c, int first, int last) {
+            bound(volumes, id, first, last, chunkVolume[c], centers ? &chunkCenters[c] : nullptr);
+        });
+        for (int c = 0; c < (int) chunkVolume.size(); c++) {
+            volume.merge(chunkVolume[c]);
+            if (centers) centers->merge(chunkCenters[c]);
+        }
+    }
+
+    // reorders id[l, r) so that the primitives satisfying pred come first and returns
+    // the first that does not; stable, so the result does not depend on the chunks
+    template <typename P>
+    int partition(std::vector <int> &id, int l, int r, P &&pred) {
+        if (r - l < chunkedRange)
+            return std::partition(id.begin() + l, id.begin() + r, pred) - id.begin();
+        int chunks = numChunks(l, r);
+        std::vector <int> first(chunks + 1, 0), buffer(r - l);
+        forChunks(l, r, [&] (int c, int lo, int hi) {
+            first[c + 1] = std::count_if(id.begin() + lo, id.begin() + hi, pred);
+        });
+        for (int c = 0; c < chunks; c++) first[c + 1] += first[c];
+        int mid = first[chunks];
+        forChunks(l, r, [&] (int c, int lo, int hi) {
+            // chunk c sends its matches after those of earlier chunks and the rest after
+            // the rest of earlier chunks
+            int yes = first[c], no = mid + (lo - l) - first[c];
+            for (int j = lo; j < hi; j++)
+                buffer[pred(id[j]) ? yes++ : no++] = id[j];
+        });
+        forChunks(l, r, [&] (int, int lo, int hi) {
+            std::copy(buffer.begin() + (lo - l), buffer.begin() + (hi - l), id.begin() + lo);
+        });
+        return l + mid;
+    }
+
+    // Each split returns the split position inside [l, r), or -1 to make the node a leaf.
+    int splitMedian(const std::vector <volume3d> &volumes, std::vector <int> &id, int l, int r,
+        const volume3d &volume) {
+        int m = (l + r) / 2;
+        if (r - l <= medianMaxLeaf) return -1;
+        int d = volume.getMaxD();
+
+        std::nth_element(id.begin() + l, id.begin() + m, id.begin() + r, [&] (int u, int v) {
+            return volumes[u].dmin[d] < volumes[v].dmin[d];
+        });
+        return m;
+    }
+
+    struct sahBinning {
+        volume3d bins[3][sahBins];
+        int count[3][sahBins] = {};
+
+        int bin(const volume3d &centers, float c, int d) const {
+            float lo = centers.dmin[d], ext = centers.dmax[d] - lo;
+            return std::min(sahBins - 1, (int)((c - lo) / ext * sahBins));
+        }
+
+        void add(const std::vector <volume3d> &volumes, const std::vector <int> &id, int l, int r,
+            const volume3d &centers) {
+            if (r - l >= chunkedRange) {
+                std::vector <sahBinning> chunk(numChunks(l, r));
+                forChunks(l, r, [&] (int c, int first, int last) {
+                    chunk[c].add(volumes, id, first, last, centers);
+                });
+                for (const sahBinning &b : chunk)
+                    for (int d = 0; d < 3; d++)
+                        for (int k = 0; k < sahBins; k++)
+                            bins[d][k].merge(b.bins[d][k]), count[d][k] += b.count[d][k];
+                return;
+            }
+            for (int d = 0; d < 3; d++) {
+                if (centers.dmax[d] - centers.dmin[d] <= 0) continue;
+                for (int j = l; j < r; j++) {
+                    int b = bin(centers, volumes[id[j]].center(d), d);
+                    bins[d][b].merge(volumes[id[j]]);
+                    count[d][b]++;
+                }
+            }
+        }
+    };
+
+    int splitSAH(const std::vector <volume3d> &volumes, std::vector <int> &id, int l, int r,
+        const volume3d &volume, const volume3d &centers) {
+        if (r - l <= 1) return -1;
+
+        sahBinning binning;
+        binning.add(volumes, id, l, r, centers);
+        float bestCost = 1e30;
+        int bestD = -1, bestBin = 0;
+        for (int d = 0; d < 3; d++) {
+            if (centers.dmax[d] - centers.dmin[d] <= 0) continue;
+            const volume3d *bins = binning.bins[d];
+            const int *count = binning.count[d];
+            // sweep from the right, then from the left to evaluate every bin boundary
+            float rightArea[sahBins];
+            int rightCount[sahBins];
+            volume3d acc;
+            int n = 0;
+            for (int b = sahBins - 1; b > 0; b--) {
+                acc.merge(bins[b]);
+                n += count[b];
+                rightArea[b] = acc.area();
+                rightCount[b] = n;
+            }
+            acc = volume3d();
+            n = 0;
+            for (int b = 0; b + 1 < sahBins; b++) {
+                acc.merge(bins[b]);
+                n += count[b];
+                if (n == 0 || rightCount[b + 1] == 0) continue;
+                float cost = acc.area() * n + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost) bestCost = cost, bestD = d, bestBin = b;
+            }
+        }
+
+        if (bestD == -1) {
+            // all centers coincide: SAH cannot separate them, fall back to halving
+            if (r - l <= sahMaxLeaf) return -1;
+            return (l + r) / 2;
+        }
+        float area = volume.area();
+        float splitCost = sahTraversalCost + (area > 0 ? sahIntersectCost * bestCost / area : 0);
+        float leafCost = sahIntersectCost * (r - l);
+        if (r - l <= sahMaxLeaf && leafCost <= splitCost) return -1;
+
+        return partition(id, l, r, [&] (int u) {
+            return binning.bin(centers, volumes[u].center(bestD), bestD) <= bestBin;
+        });
+    }
+}
+
+struct BVH::buildContext {
+    const std::vector <volume3d> &volumes;
+    std::vector <int> &id;
+    Builder builder;
+    int grain; // ranges at least this large build their children as separate tasks
+};
+
+void BVH::buildSubtree(buildContext &c, int l, int r, int depth, std::vector <bvhNode> &out) {
+    volume3d volume, centers;
+    bound(c.volumes, c.id, l, r, volume, c.builder == SAH ? &centers : nullptr);
+    int m = -1;
+    if (depth < maxDepth)
+        m = (c.builder == SAH ? splitSAH(c.volumes, c.id, l, r, volume, centers) :
+            splitMedian(c.volumes, c.id, l, r, volume));
+    int self = out.size();
+    out.emplace_back();
+    out[self].volume = volume;
+    if (m == -1) {
+        out[self].offset = l;
+        out[self].count = r - l;
+        return;
+    }
+    out[self].count = 0;
+    if (r - l < c.grain) {
+        buildSubtree(c, l, m, depth + 1, out);
+        out[self].offset = out.size();
+        buildSubtree(c, m, r, depth + 1, out);
+        return;
+    }
+    // the children cover disjoint ranges of id, so they are built side by side and
+    // appended in depth-first order afterwards
+    std::vector <bvhNode> left, right;
+    #pragma omp task default(shared)
+    buildSubtree(c, l, m, depth + 1, left);
+    buildSubtree(c, m, r, depth + 1, right);
+    #pragma omp taskwait
+    for (std::vector <bvhNode> *child : {&left, &right}) {
+        int base = out.size();
+        if (child == &right) out[self].offset = base;
+        for (bvhNode &node : *child) {
+            if (!node.count) node.offset += base;
+            out.push_back(node);
+        }
+    }
+}
+
+void BVH::build(const std::vector <volume3d> &volumes, std::vector <int> &order, Builder builder, int threads) {
+    nodes.clear();
+    order.resize(volumes.size());
+    if (volumes.empty()) return;
+    std::iota(order.begin(), order.end(), 0);
+    threads = std::max(1, threads);
+    int n = volumes.size();
+    // a few tasks per thread; the tree does not depend on where they start
+    buildContext c{volumes, order, builder, std::max(taskGrain, n / (8 * threads))};
+    #pragma omp parallel num_threads(threads) if (threads > 1 && n >= taskGrain)
+    #pragma omp single
+    buildSubtree(c, 0, n, 0, nodes);
+}
+
+uint64_t BVH::hashSettings(uint64_t hash, Builder builder, int width) {
+    const int ints[] = {builder, width, maxDepth, medianMaxLeaf, sahBins, sahMaxLeaf,
+        chunkSize, chunkedRange, taskGrain};
+    const float floats[] = {sahTraversalCost, sahIntersectCost};
+    hash = fnv1a(ints, sizeof(ints), hash);
+    return fnv1a(floats, sizeof(floats), hash);
+}
+
+bool BVH::setNodes(const void *data, size_t bytes, int primitives) {
+    nodes.clear();
+    if (bytes % sizeof(bvhNode)) return false;
+    nodes.resize(bytes / sizeof(bvhNode));
+    memcpy(nodes.data(), data, bytes);
+    // children come after their parent, leaves stay within the primitives and no node
+    // is deeper than the traversal stacks allow
+    int n = nodes.size();
+    std::vector <int> depth(n, 0);
+    for (int p = 0; p < n; p++) {
+        const bvhNode &node = nodes[p];
+        bool ok = node.count ? node.count > 0 && node.offset >= 0 && node.offset <= primitives - node.count :
+            p + 1 < n && node.offset > p + 1 && node.offset < n && depth[p] < maxDepth;
+        if (!ok) {
+            nodes.clear();
+            return false;
+        }
+        if (!node.count) depth[p + 1] = depth[node.offset] = depth[p] + 1;
+    }
+    return true;
+}
+
+void BVH::printStatistics() const {
+    if (nodes.empty()) return;
+    float rootArea = nodes[0].volume.area(), cost = 0;
+    int leaves = 0, primitives = 0;
+    std::map <int, int> histogram;
+    for (const auto &node : nodes) {
+        float ratio = rootArea > 0 ? node.volume.area() / rootArea : 1;
+        if (node.count) {
+            leaves++;
+            primitives += node.count;
+            histogram[node.count]++;
+            cost += ratio * sahIntersectCost * node.count;
+        }
+        else cost += ratio * sahTraversalCost;
+    }
+    printf("BVH: nodes = %d leaves = %d SAH cost = %.2f\n", (int)nodes.size(), leaves, cost);
+    printf("BVH: leaf size histogram:");
+    for (const auto &bin : histogram)
+        printf(" %d:%d", bin.first, bin.second);
+    printf("\n");
+    // the indexed layout kept son[2], cutd, idl, idr per node plus one index per primitive
+    size_t flat = nodes.size() * sizeof(bvhNode);
+    size_t indexed = nodes.size() * (5 * sizeof(int) + sizeof(volume3d)) + primitives * sizeof(int);
+    printf("BVH: memory = %.1fKB (%.1fKB saved over indexed nodes)\n",
+        flat / 1024., ((double)indexed - flat) / 1024.);
+}
+
+template <int W>
+void BVH::collapse(std::vector <wideNode <W>> &wide) const {
+    wide.clear();
+    // every queued binary node becomes one wide node, in queue order
+    std::vector <int> queue(1, 0);
+    for (int i = 0; i < (int) queue.size(); i++) {
+        int p = queue[i], n = 0, children[W];
+        if (nodes[p].count) children[n++] = p;
+        else children[n++] = p + 1, children[n++] = nodes[p].offset;
+        // open the inner child with the largest surface until W children are gathered
+        while (n < W) {
+            int best = -1;
+            for (int k = 0; k < n; k++)
+                if (!nodes[children[k]].count && (best == -1 ||
+                    nodes[children[k]].volume.area() > nodes[children[best]].volume.area()))
+                    best = k;
+            if (best == -1) break;
+            int c = children[best];
+            children[best] = c + 1, children[n++] = nodes[c].offset;
+        }
+        wideNode <W> node;
+        for (int k = 0; k < W; k++) {
+            const volume3d &volume = (k < n ? nodes[children[k]].volume : volume3d());
+            for (int d = 0; d < 3; d++)
+                node.dmin[d][k] = volume.dmin[d], node.dmax[d][k] = volume.dmax[d];
+            if (k >= n) {
+                node.offset[k] = 0, node.count[k] = -1;
+            }
+            else if (nodes[children[k]].count) {
+                node.offset[k] = nodes[children[k]].offset;
+                node.count[k] = nodes[children[k]].count;
+            }
+            else {
+                node.offset[k] = queue.size(), node.count[k] = 0;
+                queue.push_back(children[k]);
+            }
+        }
+        wide.push_back(node);
+    }
+}
+
+void BVH::widen(int width_) {
+    nodes4.clear();
+    nodes8.clear();
+    width = 2;
+    if (nodes.empty()) return;
+    if (width_ == 4) collapse(nodes4);
+    else if (width_ == 8) collapse(nodes8);
+    else return;
+    width = width_;
+    int count = (width == 4 ? nodes4.size() : nodes8.size());
+    size_t size = (width == 4 ? sizeof(wideNode <4>) : sizeof(wideNode <8>));
+    printf("BVH: collapsed into %d %d-wide nodes (%.1fKB)\n", count, width, count * size / 1024.);
+}
+
+namespace {
+    template <int W, typename Node>
+    int intersectChildrenScalar(const Node &node, const RayQuery &q, float tmax, float *tnear) {
+        int mask = 0;
+        for (int k = 0; k < W; k++) {
+            float t0 = 0, t1 = tmax;
+            for (int d = 0; d < 3; d++) {
+                float lo = (q.sign[d] ? node.dmax[d][k] : node.dmin[d][k]);
+                float hi = (q.sign[d] ? node.dmin[d][k] : node.dmax[d][k]);
+                t0 = fmaxf(t0, (lo - q.origin[d]) * q.invDir[d]);
+                t1 = fminf(t1, (hi - q.origin[d]) * q.invDir[d]);
+            }
+            tnear[k] = t0;
+            if (t0 <= t1) mask |= 1 << k;
+        }
+        return mask;
+    }
+}
+
+int BVH::intersectChildren(const wideNode <4> &node, const RayQuery &q, float tmax, float *tnear) {
+#ifdef __SSE__
+    __m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(tmax);
+    for (int d = 0; d < 3; d++) {
+        __m128 o = _mm_set1_ps(q.origin[d]), inv = _mm_set1_ps(q.invDir[d]);
+        __m128 lo = _mm_load_ps(q.sign[d] ? node.dmax[d] : node.dmin[d]);
+        __m128 hi = _mm_load_ps(q.sign[d] ? node.dmin[d] : node.dmax[d]);
+        // max/min return the second operand on NaN, which keeps the running bound
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(lo, o), inv), t0);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(hi, o), inv), t1);
+    }
+    _mm_storeu_ps(tnear, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+#else
+    return intersectChildrenScalar <4> (node, q, tmax, tnear);
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace {
+    const bool hasAVX2 = __builtin_cpu_supports("avx2");
+
+    __attribute__((target("avx2")))
+    int intersectChildrenAVX2(const float (*dmin)[8], const float (*dmax)[8],
+        const RayQuery &q, float tmax, float *tnear) {
+        __m256 t0 = _mm256_setzero_ps(), t1 = _mm256_set1_ps(tmax);
+        for (int d = 0; d < 3; d++) {
+            __m256 o = _mm256_set1_ps(q.origin[d]), inv = _mm256_set1_ps(q.invDir[d]);
+            __m256 lo = _mm256_load_ps(q.sign[d] ? dmax[d] : dmin[d]);
+            __m256 hi = _mm256_load_ps(q.sign[d] ? dmin[d] : dmax[d]);
+            t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(lo, o), inv), t0);
+            t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(hi, o), inv), t1);
+        }
+        _mm256_storeu_ps(tnear, t0);
+        return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+    }
+}
+#endif
+
+int BVH::intersectChildren(const wideNode <8> &node, const RayQuery &q, float tmax, float *tnear) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (hasAVX2) return intersectChildrenAVX2(node.dmin, node.dmax, q, tmax, tnear);
+#endif
+    return intersectChildrenScalar <8> (node, q, tmax, tnear);
+}
+
+int BVH::packetMask(const volume3d &volume, const RayPacket &p, const float *tmax, int mask, int n) {
+    int hit = 0;
+#ifdef __SSE__
+    // four rays at a time; the sign of invDir picks which bound is entered first
+    for (int i = 0; i < n; i += 4) {
+        __m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(1e38);
+        for (int d = 0; d < 3; d++) {
+            __m128 o = _mm_load_ps(p.origin[d] + i), inv = _mm_load_ps(p.invDir[d] + i);
+            __m128 neg = _mm_cmplt_ps(inv, _mm_setzero_ps());
+            __m128 dmin = _mm_set1_ps(volume.dmin[d]), dmax = _mm_set1_ps(volume.dmax[d]);
+            __m128 lo = _mm_or_ps(_mm_and_ps(neg, dmax), _mm_andnot_ps(neg, dmin));
+            __m128 hi = _mm_or_ps(_mm_and_ps(neg, dmin), _mm_andnot_ps(neg, dmax));
+            t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(lo, o), inv), t0);
+            t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(hi, o), inv), t1);
+        }
+        __m128 in = _mm_and_ps(_mm_cmple_ps(t0, t1), _mm_cmple_ps(t0, _mm_loadu_ps(tmax + i)));
+        hit |= _mm_movemask_ps(in) << i;
+    }
+#else
+    const float *bounds[2] = {volume.dmin, volume.dmax};
+    for (int i = 0; i < n; i++) {
+        float t0 = 0, t1 = 1e38;
+        for (int d = 0; d < 3; d++) {
+            t0 = fmaxf(t0, (bounds[p.sign[d][i]][d] - p.origin[d][i]) * p.invDir[d][i]);
+            t1 = fminf(t1, (bounds[p.sign[d][i] ^ 1][d] - p.origin[d][i]) * p.invDir[d][i]);
+        }
+        hit |= (t0 <= t1 && t0 <= tmax[i]) << i;
+    }
+#endif
+    return hit & mask;
+}
@@ -0,0 +1,70 @@
+/*
+原创性：独立实现
+*/
+
+#include "checkpoint.hpp"
+#include "hash.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+namespace {
+    const char magic[8] = {'P', 'A', '4', 'C', 'K', 'P', 'T', '1'};
+
+    struct header {
+        char magic[8];
+        int32_t width, height, samples, reserved;
+        uint64_t sceneHash;
+    };
+}
+
+bool Checkpoint::load(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr) return false;
+    header h;
+    bool ok = fread(&h, sizeof(h), 1, file) == 1 && !memcmp(h.magic, magic, sizeof(magic)) &&
+        h.width == width && h.height == height && h.sceneHash == sceneHash && h.samples >= 0;
+    std::vector <double> data(sum.size());
+    if (ok) ok = fread(data.data(), sizeof(double), data.size(), file) == data.size();
+    fclose(file);
+    if (!ok) return false;
+    samples = h.samples;
+    sum.swap(data);
+    return true;
+}
+
+bool Checkpoint::save(const char *filename) const {
+    std::string temp = std::string(filename) + ".tmp";
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (file == nullptr) {
+        printf("cannot write checkpoint '%s'\n", temp.c_str());
+        return false;
+    }
+    header h;
+    memcpy(h.magic, magic, sizeof(magic));
+    h.width = width, h.height = height, h.samples = samples, h.reserved = 0;
+    h.sceneHash = sceneHash;
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1 &&
+        fwrite(sum.data(), sizeof(double), sum.size(), file) == sum.size();
+    ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp.c_str(), filename) != 0) {
+        printf("cannot write checkpoint '%s'\n", filename);
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint64_t Checkpoint::hashFile(const char *filename) {
+    uint64_t hash = fnvOffset;
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr) return hash;
+    unsigned char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = fnv1a(buffer, n, hash);
+    fclose(file);
+    return hash;
+}
@@ -3,10 +3,11 @@
 */
 
 #include "direction.hpp"
+#include "vec3.hpp"
 
 Vector3f getReflectDir(Vector3f incident, Vector3f normal) {
-    float dot = Vector3f::dot(incident, normal);
-    return incident - 2 * dot * normal;
+    Vec3 i(incident), n(normal);
+    return i - 2 * Vec3::dot(i, n) * n;
 }
 
 void getRefractDir(Vector3f incident, Vector3f normal, bool isFront, float n, Vector3f &direction, float &weight) {
@@ -22,21 +23,22 @@ void getRefractDir(Vector3f incident, Vector3f normal, bool isFront, float n, Ve
     else weight = 0;
 }
 
-Vector3f uniformHemisphere(std::mt19937_64 &rnd) {
-    std::uniform_real_distribution <float> gen(0, 1);
-    float u = gen(rnd) * (2 * M_PI), v = gen(rnd), w = sqrtf(1 - v * v);
+Vector3f uniformHemisphere(Sampler &sampler) {
+    Vector2f s = sampler.next2D();
+    float u = s[0] * (2 * M_PI), v = s[1], w = sqrtf(1 - v * v);
     return Vector3f(w * cosf(u), w * sinf(u), v);
 }
 
-Vector3f cosWeightedHemisphere(std::mt19937_64 &rnd) {
-    std::uniform_real_distribution <float> gen(0, 1);
-    float u = sqrtf(gen(rnd)), v = gen(rnd) * (2 * M_PI);
+Vector3f cosWeightedHemisphere(Sampler &sampler) {
+    Vector2f s = sampler.next2D();
+    float u = sqrtf(s[0]), v = s[1] * (2 * M_PI);
     return Vector3f(u * cosf(v), u * sinf(v), sqrtf(1 - u * u));
 }
 
 Vector3f rotate(Vector3f base, Vector3f normal) {
-    Vector3f U = (fabsf(normal.x()) > 0.5 ? Vector3f(0, 1, 0) : Vector3f(1, 0, 0));
-    U = Vector3f::cross(U, normal).normalized();
-    Vector3f V = Vector3f::cross(U, normal);
-    return U * base.x() + V * base.y() + normal * base.z();
+    Vec3 b(base), N(normal);
+    Vec3 U = (fabsf(N.x) > 0.5 ? Vec3(0, 1, 0) : Vec3(1, 0, 0));
+    U = Vec3::cross(U, N).normalized();
+    Vec3 V = Vec3::cross(U, N);
+    return U * b.x + V * b.y + N * b.z;
 }
@@ -17,10 +17,53 @@
 #include "image.hpp"
 #include "camera.hpp"
 #include "group.hpp"
+#include "scheduler.hpp"
+#include "sampler.hpp"
+#include "checkpoint.hpp"
+#include "wavefront.hpp"
 
 #include <omp.h>
 #include <chrono>
 #include <iomanip>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace {
+    // the pixels of a checkpoint, averaged over its samples
+    void resolve(const Checkpoint &checkpoint, Image &image) {
+        int W = image.Width(), H = image.Height(), k = std::max(1, checkpoint.samples);
+        for (int y = 0; y < H; y++)
+            for (int x = 0; x < W; x++) {
+                const double *s = &checkpoint.sum[3 * (y * W + x)];
+                image.SetPixel(x, y, Vector3f(s[0] / k, s[1] / k, s[2] / k));
+            }
+    }
+
+    // one sampler per render thread
+    std::vector <std::unique_ptr <Sampler>> createSamplers(SceneParser &Parser) {
+        std::vector <std::unique_ptr <Sampler>> samplers(std::max(1, Parser.getOmpThreads()));
+        for (auto &sampler : samplers) {
+            if (Parser.getSamplerType() == 1) sampler.reset(new SobolSampler());
+            else sampler.reset(new PCGSampler());
+        }
+        return samplers;
+    }
+
+    // one wavefront integrator per render thread, or none for the depth-first one
+    std::vector <std::unique_ptr <WavefrontIntegrator>> createIntegrators(SceneParser &Parser) {
+        std::vector <std::unique_ptr <WavefrontIntegrator>> integrators;
+        if (Parser.getIntegrator() == 1)
+            for (int i = 0; i < std::max(1, Parser.getOmpThreads()); i++)
+                integrators.emplace_back(new WavefrontIntegrator(Parser));
+        return integrators;
+    }
+
+    void postprocess(Image &image, SceneParser &Parser) {
+        if (Parser.getAntialias() & 2) fxaa(image);
+        image.gammaCorrection(1 / Parser.getGamma());
+    }
+}
 
 int main(int argc, char *argv[]) {
 
@@ -28,14 +71,35 @@ int main(int argc, char *argv[]) {
         std::cout << "Argument " << argNum << " is: " << argv[argNum] << std::endl;
     }
 
-    if (argc != 3) {
-        std::cout << "Usage: ./bin/PA1 <input scene file> <output bmp file>" << std::endl;
+    // packs a scene with its meshes and textures into a bundle instead of rendering
+    if (argc == 4 && !strcmp(argv[1], "--bundle")) {
+        SceneParser Parser(argv[2]);
+        return Parser.saveBundle(argv[3]) ? 0 : 1;
+    }
+
+    // a time budget in seconds renders progressively and stops at the deadline;
+    // a camera file replaces the camera of the scene
+    double timeBudget = -1;
+    std::string cameraFile;
+    bool usage = argc < 3 || argc % 2 == 0;
+    for (int i = 3; i + 1 < argc && !usage; i += 2) {
+        if (!strcmp(argv[i], "--time-budget")) usage = (timeBudget = atof(argv[i + 1])) <= 0;
+        else if (!strcmp(argv[i], "--camera")) cameraFile = argv[i + 1];
+        else usage = true;
+    }
+    if (usage) {
+        std::cout << "Usage: ./bin/PA4 <input scene file> <output bmp file> [--time-budget <seconds>] "
+            "[--camera <camera scene file>]" << std::endl;
+        std::cout << "       ./bin/PA4 --bundle <input scene file> <output .pa4 bundle>" << std::endl;
         return 1;
     }
     std::string inputFile = argv[1];
     std::string outputFile = argv[2];  // only bmp is allowed.
 
     SceneParser Parser(inputFile.c_str());
+    if (!cameraFile.empty() && !Parser.loadCamera(cameraFile.c_str())) return 1;
+    if (timeBudget > 0 && Parser.getModel() == 0)
+        printf("WARNING:    the time budget only applies to Monte Carlo\n");
 
     int W = Parser.getCamera()->getWidth();
     int H = Parser.getCamera()->getHeight();
@@ -45,38 +109,185 @@ int main(int argc, char *argv[]) {
 
     Image image(W, H);
 
+    TileScheduler scheduler(W, H, Parser.getTileSize(), (TileScheduler::Order) Parser.getTileOrder());
+
     auto start = std::chrono::high_resolution_clock::now();
 
     if (Parser.getModel() == 0) {
         printf("model = Whitted-Style Ray Tracing\n");
-        #pragma omp parallel for collapse(2)\
-            schedule(guided) num_threads(Parser.getOmpThreads())
-        for (int y = 0; y < H; y++)
-            for (int x = 0; x < W; x++)
-                image.SetPixel(x, y, tracingWhitted(x, y, Parser));
+        int packet = Parser.getPacketSize();
+        // 2x2, 4x2 or 4x4 blocks of pixels share one packet
+        int bw = packet == 1 ? 1 : (packet == 4 ? 2 : 4), bh = packet / bw;
+        scheduler.run(Parser.getOmpThreads(), [&](const TileScheduler::tile &t, int worker) {
+            if (packet == 1) {
+                for (int y = t.y0; y < t.y1; y++)
+                    for (int x = t.x0; x < t.x1; x++)
+                        image.SetPixel(x, y, tracingWhitted(x, y, Parser));
+                return;
+            }
+            int xs[RayPacket::maxSize], ys[RayPacket::maxSize];
+            Vector3f colors[RayPacket::maxSize];
+            for (int by = t.y0; by < t.y1; by += bh)
+                for (int bx = t.x0; bx < t.x1; bx += bw) {
+                    int n = 0;
+                    for (int y = by; y < std::min(by + bh, t.y1); y++)
+                        for (int x = bx; x < std::min(bx + bw, t.x1); x++)
+                            xs[n] = x, ys[n++] = y;
+                    tracingWhitted(xs, ys, n, Parser, colors);
+                    for (int i = 0; i < n; i++)
+                        image.SetPixel(xs[i], ys[i], colors[i]);
+                }
+        });
+    }
+
+    else if (Parser.getProgressive() || timeBudget > 0) {
+        printf("model = Monte Carlo Ray Tracing, progressive\n");
+        auto deadline = start + std::chrono::duration_cast <std::chrono::high_resolution_clock::duration> (
+            std::chrono::duration <double> (timeBudget));
+        auto remaining = [&]() {
+            return std::chrono::duration <double> (deadline - std::chrono::high_resolution_clock::now()).count();
+        };
+        double secondsPerSample = 0;
+        std::vector <std::unique_ptr <Sampler>> samplers = createSamplers(Parser);
+        std::vector <std::unique_ptr <WavefrontIntegrator>> integrators = createIntegrators(Parser);
+        int SPP = Parser.getSPP();
+        std::string checkpointFile = outputFile + ".ckpt";
+        uint64_t sceneHash = Checkpoint::hashFile(inputFile.c_str());
+        if (!cameraFile.empty()) sceneHash = sceneHash * 31 + Checkpoint::hashFile(cameraFile.c_str());
+        Checkpoint checkpoint(W, H, sceneHash);
+        if (checkpoint.load(checkpointFile.c_str()))
+            printf("resuming from %s at %d / %d samples per pixel\n", checkpointFile.c_str(), checkpoint.samples, SPP);
+        // pass sizes double, so the image after every pass uses all samples taken so far
+        while (checkpoint.samples < SPP) {
+            int first = checkpoint.samples, last = std::min(SPP, std::max(1, 2 * first));
+            if (timeBudget > 0 && secondsPerSample > 0) {
+                // shrink the pass to what the last pass says fits before the deadline,
+                // keeping a margin for its noise and the checkpoint write
+                int fit = 0.9 * remaining() / secondsPerSample;
+                if (fit < 1) break;
+                last = std::min(last, first + fit);
+            }
+            // a resumed render has no timing yet, so it measures a single sample first
+            else if (timeBudget > 0) last = first + 1;
+            // a pass accumulates into a copy that only replaces the checkpoint once
+            // every pixel has all of its samples
+            std::vector <double> sum = checkpoint.sum;
+            bool expired = false;
+            auto passStart = std::chrono::high_resolution_clock::now();
+            scheduler.run(Parser.getOmpThreads(), [&](const TileScheduler::tile &t, int worker) {
+                if (!integrators.empty()) {
+                    if (timeBudget > 0 && remaining() < 0) {
+                        #pragma omp atomic write
+                        expired = true;
+                        return;
+                    }
+                    integrators[worker]->render(t, first, last, sum.data());
+                    return;
+                }
+                for (int y = t.y0; y < t.y1; y++)
+                    for (int x = t.x0; x < t.x1; x++) {
+                        if (timeBudget > 0 && remaining() < 0) {
+                            #pragma omp atomic write
+                            expired = true;
+                            return;
+                        }
+                        double *s = &sum[3 * (y * W + x)];
+                        for (int k = first; k < last; k++) {
+                            Vector3f c = tracingMC(x, y, k, Parser, *samplers[worker]);
+                            s[0] += c[0], s[1] += c[1], s[2] += c[2];
+                        }
+                    }
+            });
+            if (expired) {
+                printf("time budget reached, dropped the unfinished pass to %d samples per pixel\n", last);
+                break;
+            }
+            // the slowest pass so far, as timings on a shared machine jitter
+            secondsPerSample = std::max(secondsPerSample, std::chrono::duration <double> (
+                std::chrono::high_resolution_clock::now() - passStart).count() / (last - first));
+            checkpoint.sum.swap(sum);
+            checkpoint.samples = last;
+            checkpoint.save(checkpointFile.c_str());
+            Image preview(W, H);
+            resolve(checkpoint, preview);
+            postprocess(preview, Parser);
+            preview.SaveImage(outputFile.c_str());
+            printf("pass done: %d / %d samples per pixel\n", last, SPP);
+        }
+        resolve(checkpoint, image);
+        if (timeBudget > 0) {
+            // the achieved sample count next to the image, for batch scheduling
+            std::string sidecarFile = outputFile + ".spp";
+            FILE *sidecar = fopen(sidecarFile.c_str(), "w");
+            if (sidecar == nullptr) printf("cannot write '%s'\n", sidecarFile.c_str());
+            else {
+                fprintf(sidecar, "spp %d\nbudget %.2lf\n", checkpoint.samples, timeBudget);
+                fclose(sidecar);
+            }
+            printf("time budget: %d samples per pixel in %.2lfs\n", checkpoint.samples, timeBudget - remaining());
+        }
     }
 
     else {
-        printf("model = Monte Carlo Ray Tracing\n");
+        printf("model = Monte Carlo Ray Tracing%s\n", Parser.getIntegrator() == 1 ? ", wavefront" : "");
         std::cout << std::fixed << std::setprecision(1);
-        int cnt = 0;
-        #pragma omp parallel for collapse(2)\
-            schedule(guided) num_threads(Parser.getOmpThreads())
-        for (int y = 0; y < H; y++)
-            for (int x = 0; x < W; x++) {
-                image.SetPixel(x, y, tracingMC(x, y, Parser));
-                if (x + 1 == H) {
-                    #pragma omp critical
-                    {
-                        ++cnt;
-                        std::cout << "\rrate = " << cnt << " / " << H << " = " <<
-                            100. * cnt / H << "%" << std::flush;
-                        if (cnt % 80 == 0)
-                            image.SaveImage(outputFile.c_str());
+        int tiles = scheduler.getNumTiles(), cnt = 0;
+        long long pixels = 0;
+        std::vector <int> samples(W * H);
+        std::vector <std::unique_ptr <Sampler>> samplers = createSamplers(Parser);
+        std::vector <std::unique_ptr <WavefrontIntegrator>> integrators = createIntegrators(Parser);
+        std::vector <double> sum(integrators.empty() ? 0 : 3 * W * H);
+        scheduler.run(Parser.getOmpThreads(), [&](const TileScheduler::tile &t, int worker) {
+            if (!integrators.empty()) {
+                int SPP = Parser.getSPP();
+                integrators[worker]->render(t, 0, SPP, sum.data());
+                for (int y = t.y0; y < t.y1; y++)
+                    for (int x = t.x0; x < t.x1; x++) {
+                        const double *s = &sum[3 * (y * W + x)];
+                        image.SetPixel(x, y, Vector3f(s[0] / SPP, s[1] / SPP, s[2] / SPP));
+                        samples[y * W + x] = SPP;
                     }
-                }
+            } else {
+                for (int y = t.y0; y < t.y1; y++)
+                    for (int x = t.x0; x < t.x1; x++)
+                        image.SetPixel(x, y, tracingMC(x, y, Parser, *samplers[worker], samples[y * W + x]));
+            }
+            #pragma omp critical
+            {
+                ++cnt;
+                std::cout << "\rrate = " << cnt << " / " << tiles << " = " <<
+                    100. * cnt / tiles << "%" << std::flush;
+                // save a preview every 80 rows worth of pixels, as the row loop did
+                long long before = pixels / (80LL * W);
+                pixels += (long long) (t.x1 - t.x0) * (t.y1 - t.y0);
+                if (pixels / (80LL * W) != before)
+                    image.SaveImage(outputFile.c_str());
             }
+        });
         std::cout << std::endl;
+
+        if (Parser.getAdaptive()) {
+            long long total = 0;
+            for (int n : samples) total += n;
+            printf("adaptive sampling: %.1f samples per pixel on average, at most %d\n",
+                (double) total / (W * H), Parser.getMaxSPP());
+        }
+        if (Parser.getHeatmap()) {
+            // black -> red -> yellow -> white as the sample count goes up to maxSPP
+            Image heatmap(W, H);
+            for (int y = 0; y < H; y++)
+                for (int x = 0; x < W; x++) {
+                    float t = 3.f * samples[y * W + x] / Parser.getMaxSPP();
+                    heatmap.SetPixel(x, y, Vector3f(std::min(t, 1.f),
+                        std::min(std::max(t - 1, 0.f), 1.f), std::min(std::max(t - 2, 0.f), 1.f)));
+                }
+            std::string heatmapFile = outputFile;
+            // out.bmp -> out_spp.bmp; a name without an extension gets one
+            size_t dot = heatmapFile.rfind('.'), slash = heatmapFile.rfind('/');
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) heatmapFile += "_spp.bmp";
+            else heatmapFile.insert(dot, "_spp");
+            heatmap.SaveImage(heatmapFile.c_str());
+        }
     }
 
     auto end = std::chrono::high_resolution_clock::now();
@@ -84,8 +295,7 @@ int main(int argc, char *argv[]) {
 
     printf("rendering time: %.2lfs\n", duration.count() / 1000.);
 
-    if (Parser.getAntialias() & 2) fxaa(image);
-    image.gammaCorrection(1 / Parser.getGamma());
+    postprocess(image, Parser);
     image.SaveImage(outputFile.c_str());
 
     return 0;
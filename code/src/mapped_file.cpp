@@ -0,0 +1,41 @@
+/*
+原创性：独立实现
+*/
+
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const char *filename) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = st.st_size;
+    if (length > 0) {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        // the parsers read files front to back
+        madvise(p, length, MADV_SEQUENTIAL);
+        begin = static_cast <const char *> (p);
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+    opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (begin != nullptr) munmap(const_cast <char *> (begin), length);
+    begin = nullptr, length = 0, opened = false;
+}
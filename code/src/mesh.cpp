@@ -3,28 +3,238 @@
 */
 
 #include "mesh.hpp"
-#include <fstream>
+#include "mapped_file.hpp"
+#include "checkpoint.hpp"
+#include <cstdio>
+#include <string>
+#include <unistd.h>
 #include <iostream>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <utility>
-#include <sstream>
 #include <numeric>
+#include <chrono>
 
-int Mesh::intersect_tid(const Ray &r, Hit &h, float tmin) {
-    int tid = -1;
-    if (useBVH) BVHintersect(r, h, tmin, 0, tid);
-    else {
-        for (int triId = 0; triId < (int)triangles.size(); ++triId)
-            if (triangles[triId].intersect(r, h, tmin)) tid = triId;
+namespace {
+    template <typename T>
+    void permute(std::vector <T> &a, const std::vector <int> &order) {
+        if (a.size() != order.size()) return;
+        std::vector <T> b;
+        b.reserve(a.size());
+        for (int i : order) b.push_back(a[i]);
+        a.swap(b);
+    }
+
+    const char cacheMagic[8] = {'P', 'A', '4', 'B', 'V', 'H', 'C', '1'};
+    // cacheFormat is bumped whenever the loader changes what a cache holds; the sizes
+    // of the records stored as they are take part, so a layout change misses too
+    const uint32_t cacheFormat = 2;
+    static_assert(BVH::nodeSize < 256 && sizeof(Mesh::TriangleIndex) == 3 * sizeof(int),
+        "the cache version has a byte for the node size and assumes packed indices");
+    static_assert(sizeof(Vector2f) == 2 * sizeof(float) && sizeof(Vector3f) == 3 * sizeof(float),
+        "vt and vn are stored as plain floats");
+    const uint32_t cacheVersion = cacheFormat << 16 | BVH::nodeSize << 8 | TriangleSoA::components;
+
+    struct cacheHeader {
+        char magic[8];
+        uint32_t version, flags; // flags: 1 = useVT, 2 = useVN
+        uint64_t key;
+        // triangles, vt, vn, vt_id, vn_id, then the BVH nodes in bytes
+        uint64_t count[6];
+    };
+
+    template <typename T>
+    bool writeArray(FILE *file, const std::vector <T> &a) {
+        return a.empty() || fwrite(a.data(), sizeof(T), a.size(), file) == a.size();
+    }
+
+    // copies count elements from p into a and advances p, unless they run past end
+    template <typename T>
+    bool readArray(const char *&p, const char *end, uint64_t count, std::vector <T> &a) {
+        if (count > (uint64_t)(end - p) / sizeof(T)) return false;
+        a.resize(count);
+        memcpy((void *) a.data(), p, count * sizeof(T));
+        p += count * sizeof(T);
+        return true;
     }
+
+    // Reads an OBJ file in place. The file is mapped, so end is not followed by a
+    // terminating zero and nothing may look past it.
+    struct ObjCursor {
+        const char *p, *end;
+
+        // one corner of a face; vt and vn are -1 when absent
+        struct Corner {
+            int v = -1, vt = -1, vn = -1;
+        };
+
+        void skipSpaces() {
+            while (p != end && (*p == ' ' || *p == '\t')) p++;
+        }
+
+        void nextLine() {
+            while (p != end && *p != '\n') p++;
+            if (p != end) p++;
+        }
+
+        // consumes word if the line continues with it followed by a space
+        bool keyword(const char *word) {
+            size_t n = strlen(word);
+            if (end - p <= (ptrdiff_t) n || memcmp(p, word, n) || (p[n] != ' ' && p[n] != '\t')) return false;
+            p += n;
+            return true;
+        }
+
+        static bool isDigit(char ch) {
+            return ch >= '0' && ch <= '9';
+        }
+
+        bool readInt(int &x) {
+            const char *q = p;
+            bool negative = q != end && *q == '-';
+            if (q != end && (*q == '-' || *q == '+')) q++;
+            if (q == end || !isDigit(*q)) return false;
+            long long value = 0;
+            for (; q != end && isDigit(*q); q++)
+                if (value < (1LL << 40)) value = value * 10 + (*q - '0');
+            x = negative ? -value : value;
+            p = q;
+            return true;
+        }
+
+        bool readFloat(float &x) {
+            skipSpaces();
+            const char *start = p, *q = p;
+            bool negative = q != end && *q == '-';
+            if (q != end && (*q == '-' || *q == '+')) q++;
+            // up to 19 significant digits in mantissa, the value is mantissa * 10^exponent
+            unsigned long long mantissa = 0;
+            int digits = 0, exponent = 0;
+            bool any = false;
+            for (; q != end && isDigit(*q); q++, any = true) {
+                if (digits < 19) mantissa = mantissa * 10 + (*q - '0'), digits += mantissa > 0;
+                else exponent++;
+            }
+            if (q != end && *q == '.')
+                for (q++; q != end && isDigit(*q); q++, any = true)
+                    if (digits < 19) mantissa = mantissa * 10 + (*q - '0'), digits += mantissa > 0, exponent--;
+            if (!any) return false;
+            if (q != end && (*q == 'e' || *q == 'E')) {
+                p = q + 1;
+                int e;
+                if (readInt(e)) exponent += e, q = p;
+            }
+            p = q;
+            static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+            if (mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+                // both factors are exact doubles, so this rounds only once before the float
+                double value = exponent < 0 ? mantissa / pow10[-exponent] : mantissa * pow10[exponent];
+                x = negative ? -value : value;
+                return true;
+            }
+            // long or extreme numbers are rare enough for the library
+            char buffer[64];
+            size_t n = std::min <size_t> (q - start, sizeof(buffer) - 1);
+            memcpy(buffer, start, n);
+            buffer[n] = 0;
+            x = strtof(buffer, nullptr);
+            return true;
+        }
+
+        // 1-based or, if negative, relative to the last of count elements; -1 if out of range
+        static int resolve(int index, size_t count) {
+            long long i = index > 0 ? index - 1LL : (long long) count + index;
+            return index != 0 && i >= 0 && i < (long long) count ? i : -1;
+        }
+
+        // reads a corner v, v/vt, v//vn or v/vt/vn; returns 1 if one was read, 0 at the
+        // end of the line and -1 if the corner is malformed or its vertex is undefined
+        int readCorner(Corner &corner, size_t nv, size_t nvt, size_t nvn) {
+            skipSpaces();
+            if (p == end || *p == '\n' || *p == '\r' || *p == '#') return 0;
+            int index;
+            if (!readInt(index) || (corner.v = resolve(index, nv)) < 0) return -1;
+            corner.vt = corner.vn = -1;
+            if (p != end && *p == '/') {
+                p++;
+                if (readInt(index)) corner.vt = resolve(index, nvt);
+                if (p != end && *p == '/') {
+                    p++;
+                    if (readInt(index)) corner.vn = resolve(index, nvn);
+                }
+            }
+            if (p != end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' && *p != '#') return -1;
+            return 1;
+        }
+    };
+}
+
+int Mesh::intersect_tid(const Ray &r, float tmin, float &t, float &u, float &v) {
+    int tid = -1;
+    auto leaf = [&] (int first, int count) {
+        int triId = packed.intersect(r, first, count, tmin, t, u, v);
+        if (triId != -1) tid = triId;
+    };
+    if (useBVH) bvh.intersect(r, t, leaf);
+    else leaf(0, packed.getSize());
     return tid;
 }
 
+bool Mesh::occluded(const Ray &r, float tmin, float tmax) {
+    bool found = false;
+    float u, v;
+    auto leaf = [&] (int first, int count) {
+        if (packed.intersect(r, first, count, tmin, tmax, u, v) == -1) return;
+        found = true;
+        tmax = -1;
+    };
+    if (useBVH) bvh.intersect(r, tmax, leaf);
+    else leaf(0, packed.getSize());
+    return found;
+}
+
+// Traversal only records the distance, the triangle and its barycentrics;
+// normal, color and texture are evaluated once for the closest hit.
 bool Mesh::intersect(const Ray &r, Hit &h, float tmin) {
-    int tid = intersect_tid(r, h, tmin);
-    if (tid != -1 && (useVT || useVN)) {
-        Vector3f weight = triangles[tid].getWeight(r, h);
+    float t = h.getT(), u, v;
+    int tid = intersect_tid(r, tmin, t, u, v);
+    if (tid == -1) return false;
+    setHit(r, h, tid, t, u, v);
+    return true;
+}
+
+int Mesh::intersectPacket(const RayPacket &p, Hit *hits, float tmin, int mask) {
+    float t[RayPacket::maxSize], u[RayPacket::maxSize], v[RayPacket::maxSize];
+    int tid[RayPacket::maxSize];
+    for (int i = 0; i < RayPacket::maxSize; i++)
+        t[i] = i < p.size ? hits[i].getT() : 0, tid[i] = -1;
+    auto leaf = [&] (int first, int count, int active) {
+        for (int i = 0; i < p.size; i++) {
+            if (!(active >> i & 1)) continue;
+            int triId = packed.intersect(p.rays[i], first, count, tmin, t[i], u[i], v[i]);
+            if (triId != -1) tid[i] = triId;
+        }
+    };
+    if (useBVH) bvh.intersect(p, t, mask, leaf);
+    else leaf(0, packed.getSize(), mask);
+    int hit = 0;
+    for (int i = 0; i < p.size; i++)
+        if (tid[i] != -1) {
+            setHit(p.rays[i], hits[i], tid[i], t[i], u[i], v[i]);
+            hit |= 1 << i;
+        }
+    return hit;
+}
+
+void Mesh::setHit(const Ray &r, Hit &h, int tid, float t, float u, float v) {
+    // as Triangle::setHit, with the normal taken from the packed edges
+    Vec3 normal = packed.getNormal(tid);
+    float dot = Vec3::dot(Vec3(r.getDirection()), normal);
+    h.set(t, material, dot < 0 ? normal : -normal, material->getColor(), dot < 0, Vector3f::ZERO);
+    if (useVT || useVN) {
+        Vector3f weight(1 - u - v, u, v);
         if (useVT && h.getIsFront())
             h.setColor(material->getColor(weight[0] * vt[vt_id[tid][0]] +
                 weight[1] * vt[vt_id[tid][1]] + weight[2] * vt[vt_id[tid][2]]));
@@ -33,125 +243,197 @@ bool Mesh::intersect(const Ray &r, Hit &h, float tmin) {
                 weight[1] * vn[vn_id[tid][1]] + weight[2] * vn[vn_id[tid][2]]);
         }
     }
-    return tid != -1;
 }
 
-Mesh::Mesh(const char *filename, Material *material) : Object3D(material) {
-    std::ifstream f;
-    f.open(filename);
-    if (!f.is_open()) {
+void Mesh::load(const char *filename) {
+    auto start = std::chrono::high_resolution_clock::now();
+    MappedFile file(filename);
+    if (!file.isOpen()) {
         std::cout << "Cannot open " << filename << "\n";
         return;
     }
-    std::string line;
-    std::string vTok("v");
-    std::string fTok("f");
-    std::string vtTok("vt");
-    std::string vnTok("vn");
-    char bslash = '/', space = ' ';
-    std::string tok;
-    int texID;
-    useBVH = useVT = useVN = false;
-    static int A[12];
-    while (true) {
-        std::getline(f, line);
-        if (f.eof()) {
-            break;
-        }
-        if (line.size() < 3) {
-            continue;
-        }
-        if (line.at(0) == '#') {
-            continue;
-        }
-        std::stringstream ss(line);
-        ss >> tok;
-        if (tok == vTok) {
-            Vector3f v;
-            ss >> v[0] >> v[1] >> v[2];
-            add_v(v);
-        } else if (tok == vtTok) {
-            Vector2f vt;
-            ss >> vt[0];
-            ss >> vt[1];
-            add_vt(vt);
-        } else if (tok == vnTok) {
-            Vector3f vn;
-            ss >> vn[0] >> vn[1] >> vn[2];
-            add_vn(vn);
-        } else if (tok == fTok) {
-            if (line.find(bslash) != std::string::npos) {
-                int cnt = std::count(line.begin(), line.end(), bslash) / 2;
-                std::replace(line.begin(), line.end(), bslash, space);
-                std::stringstream facess(line);
-                facess >> tok;
-                for (int i = 0; i < cnt * 3; i++) facess >> A[i], A[i]--;
-                add_vid(A[0], A[3], A[6]);
-                add_vtid(A[1], A[4], A[7]);
-                add_vnid(A[2], A[5], A[8]);
-                if (cnt == 4) {
-                    add_vid(A[6], A[9], A[0]);
-                    add_vtid(A[7], A[10], A[1]);
-                    add_vnid(A[8], A[11], A[2]);
+    ObjCursor c{file.data(), file.data() + file.size()};
+    int badFaces = 0;
+    for (; c.p != c.end; c.nextLine()) {
+        c.skipSpaces();
+        if (c.keyword("v")) {
+            Vector3f u;
+            if (c.readFloat(u[0]) && c.readFloat(u[1]) && c.readFloat(u[2])) add_v(u);
+        } else if (c.keyword("vt")) {
+            Vector2f u;
+            if (c.readFloat(u[0]) && c.readFloat(u[1])) add_vt(u);
+        } else if (c.keyword("vn")) {
+            Vector3f u;
+            if (c.readFloat(u[0]) && c.readFloat(u[1]) && c.readFloat(u[2])) add_vn(u);
+        } else if (c.keyword("f")) {
+            // fan of an n-gon: (0, 1, 2), then (i, i + 1, 0) as quads have always been split
+            size_t nv = v_id.size(), nvt = vt_id.size(), nvn = vn_id.size();
+            ObjCursor::Corner first, prev, cur;
+            int n = 0, status;
+            while ((status = c.readCorner(cur, v.size(), vt.size(), vn.size())) > 0) {
+                if (n == 0) first = cur;
+                else if (n >= 2) {
+                    const ObjCursor::Corner &a = n == 2 ? first : prev, &b = n == 2 ? prev : cur,
+                        &d = n == 2 ? cur : first;
+                    add_vid(a.v, b.v, d.v);
+                    if (a.vt >= 0 && b.vt >= 0 && d.vt >= 0) add_vtid(a.vt, b.vt, d.vt);
+                    if (a.vn >= 0 && b.vn >= 0 && d.vn >= 0) add_vnid(a.vn, b.vn, d.vn);
                 }
-            } else {
-                ss >> A[0] >> A[1] >> A[2];
-                add_vid(A[0] - 1, A[1] - 1, A[2] - 1);
+                prev = cur, n++;
             }
-        } 
+            if (status < 0) {
+                // a corner that does not parse or points past what is defined drops the face
+                v_id.resize(nv), vt_id.resize(nvt), vn_id.resize(nvn);
+                badFaces++;
+            }
+        }
+    }
+    if (badFaces) printf("WARNING:    %s: skipped %d malformed faces\n", filename, badFaces);
+    // texture coordinates and normals are only used if every face has them
+    if (useVT && vt_id.size() != v_id.size()) {
+        printf("WARNING:    %s: not every face has texture coordinates, ignoring them\n", filename);
+        useVT = false;
+    }
+    if (useVN && vn_id.size() != v_id.size()) {
+        printf("WARNING:    %s: not every face has normals, ignoring them\n", filename);
+        useVN = false;
     }
+    auto end = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration_cast <std::chrono::microseconds> (end - start).count() / 1000.;
+    double mb = file.size() / (1024. * 1024.);
+    printf("OBJ: %s size = %.2lfMB load time = %.2lfms (%.1lfMB/s)\n",
+        filename, mb, ms, ms > 0 ? mb / (ms / 1000) : 0.);
     generate();
-
-    f.close();
 }
 
 void Mesh::generate() {
     printf("mesh: V = %d F = %d useVT = %d useVN = %d\n",
         (int)v.size(), (int)v_id.size(), useVT, useVN);
     
-    triangles.reserve(v_id.size());
+    packed.resize(v_id.size());
     for (int triId = 0; triId < (int) v_id.size(); ++triId)
-        triangles.emplace_back(v[v_id[triId][0]], v[v_id[triId][1]], v[v_id[triId][2]], material);
+        packed.set(triId, v[v_id[triId][0]], v[v_id[triId][1]], v[v_id[triId][2]]);
 }
 
-void Mesh::buildBVH() {
+void Mesh::buildBVH(BVH::Builder builder, int width, int threads) {
+    auto start = std::chrono::high_resolution_clock::now();
     useBVH = true;
-    bvhId.resize(triangles.size());
-    std::iota(bvhId.begin(), bvhId.end(), 0);
-    bvhTree.emplace_back(0, 0, bvhId.size());
-    for (int i = 0; i < bvhTree.size(); i++) {
-        int l = bvhTree[i].idl, r = bvhTree[i].idr, m = (l + r) / 2;
-        for (int j = l; j < r; j++)
-            bvhTree[i].volume.merge(triangles[bvhId[j]]);
-        if (r - l <= 3) {
-            bvhTree[i].cutd = -1;
-            continue;
-        }
-        bvhTree[i].cutd = bvhTree[i].volume.getMaxD();
-        int d = bvhTree[i].cutd;
-
-        std::nth_element(bvhId.begin() + l, bvhId.begin() + m, bvhId.begin() + r, [&] (int u, int v) {
-            return triangles[u].dmin(d) < triangles[v].dmin(d);
-        });
-        bvhTree[i].son[0] = bvhTree.size();
-        bvhTree.emplace_back(0, l, m);
-        bvhTree[i].son[1] = bvhTree.size();
-        bvhTree.emplace_back(0, m, r);
+    std::vector <volume3d> volumes(packed.getSize());
+    for (int triId = 0; triId < packed.getSize(); ++triId)
+        packed.getVolume(triId, volumes[triId]);
+    std::vector <int> order;
+    bvh.build(volumes, order, builder, threads);
+    // leaves address triangles directly, so store them in leaf order
+    packed.permute(order);
+    permute(v_id, order);
+    permute(vt_id, order);
+    permute(vn_id, order);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast <std::chrono::microseconds> (end - start);
+    printf("BVH: builder = %s threads = %d build time = %.2lfms\n",
+        builder == BVH::SAH ? "SAH" : "median", threads, duration.count() / 1000.);
+    bvh.printStatistics();
+    bvh.widen(width);
+}
+
+uint64_t Mesh::cacheKey(const char *filename, BVH::Builder builder, int width) {
+    return BVH::hashSettings(Checkpoint::hashFile(filename), builder, width);
+}
+
+bool Mesh::loadCache(const char *cacheFile, uint64_t key, int width) {
+    auto start = std::chrono::high_resolution_clock::now();
+    MappedFile file(cacheFile);
+    if (!file.isOpen() || !loadCache(file.data(), file.size(), key, width, cacheFile)) return false;
+    auto end = std::chrono::high_resolution_clock::now();
+    printf("BVH: loaded %s in %.2lfms\n", cacheFile,
+        std::chrono::duration_cast <std::chrono::microseconds> (end - start).count() / 1000.);
+    return true;
+}
+
+bool Mesh::loadCache(const char *data, size_t size, uint64_t key, int width, const char *name) {
+    if (size < sizeof(cacheHeader)) return false;
+    cacheHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) || h.version != cacheVersion || h.key != key)
+        return false;
+    const char *p = data + sizeof(h), *last = data + size;
+    // the triangles are stored packed and in leaf order, so they are copied as they are
+    uint64_t n = h.count[0];
+    bool ok = n <= (uint64_t)(last - p) / (TriangleSoA::components * sizeof(float)) && n < (1u << 31);
+    if (ok) {
+        packed.resize(n);
+        for (int c = 0; c < TriangleSoA::components; c++, p += n * sizeof(float))
+            memcpy(packed.component(c), p, n * sizeof(float));
     }
+    ok = ok && readArray(p, last, h.count[1], vt) && readArray(p, last, h.count[2], vn) &&
+        readArray(p, last, h.count[3], vt_id) && readArray(p, last, h.count[4], vn_id) &&
+        h.count[5] == (uint64_t)(last - p);
+    useVT = h.flags & 1, useVN = h.flags & 2;
+    // every index has to point into its array before shading reads through it
+    auto inRange = [] (const std::vector <TriangleIndex> &ids, size_t n) {
+        for (const TriangleIndex &id : ids)
+            for (int k = 0; k < 3; k++)
+                if (id.x[k] < 0 || id.x[k] >= (int64_t) n) return false;
+        return true;
+    };
+    ok = ok && (!useVT || (vt_id.size() == n && inRange(vt_id, vt.size()))) &&
+        (!useVN || (vn_id.size() == n && inRange(vn_id, vn.size())));
+    ok = ok && bvh.setNodes(p, h.count[5], n);
+    if (!ok) {
+        printf("WARNING:    ignoring damaged BVH cache '%s'\n", name);
+        vt.clear(), vn.clear(), vt_id.clear(), vn_id.clear();
+        packed.resize(0);
+        useVT = useVN = false;
+        return false;
+    }
+    printf("mesh: F = %d useVT = %d useVN = %d\n", packed.getSize(), useVT, useVN);
+    // a mesh without use_BVH is stored without nodes
+    useBVH = !bvh.empty();
+    bvh.widen(width);
+    return true;
+}
+
+bool Mesh::writeCache(FILE *file, uint64_t key) const {
+    cacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+    h.version = cacheVersion;
+    h.flags = (useVT ? 1 : 0) | (useVN ? 2 : 0);
+    h.key = key;
+    size_t n = packed.getSize(), nodeBytes = useBVH ? bvh.nodeBytes() : 0;
+    uint64_t count[6] = {n, vt.size(), vn.size(), vt_id.size(), vn_id.size(), nodeBytes};
+    memcpy(h.count, count, sizeof(count));
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1;
+    for (int c = 0; c < TriangleSoA::components && ok; c++)
+        ok = n == 0 || fwrite(packed.component(c), sizeof(float), n, file) == n;
+    return ok && writeArray(file, vt) && writeArray(file, vn) && writeArray(file, vt_id) &&
+        writeArray(file, vn_id) && fwrite(bvh.nodeData(), 1, nodeBytes, file) == nodeBytes;
 }
 
-void Mesh::BVHintersect(const Ray &r, Hit &h, float tmin, int p, int &tid) {
-    int d = bvhTree[p].cutd;
-    float t = bvhTree[p].volume.intersect(r);
-    if (t == -1 || t > h.getT()) return;
-    bool result = false;
-    if (d == -1) {
-        for (int i = bvhTree[p].idl; i < bvhTree[p].idr; i++)
-            if (triangles[bvhId[i]].intersect(r, h, tmin)) tid = bvhId[i];
+void Mesh::saveCache(const char *cacheFile, uint64_t key) const {
+    // written aside and renamed, so that a concurrent render never maps half a file;
+    // the name is per process and mesh, as a scene may load the same OBJ twice
+    std::string temp = std::string(cacheFile) + "." + std::to_string(getpid()) + "." +
+        std::to_string((uintptr_t) this) + ".tmp";
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (file == nullptr) {
+        printf("cannot write BVH cache '%s'\n", temp.c_str());
+        return;
     }
-    else {
-        int k = (r.getDirection()[d] < 0);
-        BVHintersect(r, h, tmin, bvhTree[p].son[k], tid);
-        BVHintersect(r, h, tmin, bvhTree[p].son[k ^ 1], tid);
+    bool ok = writeCache(file, key);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp.c_str(), cacheFile) != 0) {
+        printf("cannot write BVH cache '%s'\n", cacheFile);
+        remove(temp.c_str());
+    }
+}
+
+bool Mesh::getVolume(volume3d &volume) {
+    if (useBVH && !bvh.empty()) {
+        volume.merge(bvh.getVolume());
+        return true;
     }
+    for (int triId = 0; triId < packed.getSize(); ++triId)
+        packed.getVolume(triId, volume);
+    return true;
 }
@@ -0,0 +1,117 @@
+/*
+原创性：独立实现
+*/
+
+#include "scene_bundle.hpp"
+#include <cstring>
+
+namespace {
+    const char magic[8] = {'P', 'A', '4', 'S', 'C', 'E', 'N', '1'};
+
+    // sections follow the magic, each starting at a multiple of 8 bytes
+    struct sectionHeader {
+        uint32_t type, nameLength;
+        uint64_t size;
+    };
+
+    size_t align8(size_t n) {
+        return (n + 7) & ~(size_t) 7;
+    }
+}
+
+bool SceneBundle::open(const char *filename) {
+    sections.clear();
+    if (!file.open(filename)) return false;
+    const char *begin = file.data();
+    size_t size = file.size(), pos = sizeof(magic);
+    if (size < pos || memcmp(begin, magic, sizeof(magic))) {
+        printf("'%s' is not a scene bundle\n", filename);
+        file.close();
+        return false;
+    }
+    while (pos < size) {
+        sectionHeader h;
+        if (size - pos < sizeof(h)) break;
+        memcpy(&h, begin + pos, sizeof(h));
+        pos += sizeof(h);
+        if (h.nameLength > size - pos || h.size > size - pos - h.nameLength) break;
+        Section s;
+        s.type = h.type;
+        s.name.assign(begin + pos, h.nameLength);
+        s.data = begin + pos + h.nameLength;
+        s.size = h.size;
+        sections.push_back(s);
+        pos = align8(pos + h.nameLength + h.size);
+    }
+    if (pos < size) {
+        printf("scene bundle '%s' is damaged\n", filename);
+        sections.clear();
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+const SceneBundle::Section *SceneBundle::find(SectionType type, const std::string &name) const {
+    for (const Section &s : sections)
+        if (s.type == type && s.name == name) return &s;
+    return nullptr;
+}
+
+SceneBundleWriter::~SceneBundleWriter() {
+    if (file == nullptr) return;
+    fclose(file);
+    remove(temp.c_str());
+}
+
+bool SceneBundleWriter::open(const char *filename) {
+    target = filename;
+    temp = target + ".tmp";
+    file = fopen(temp.c_str(), "w+b");
+    if (file == nullptr) {
+        printf("cannot write scene bundle '%s'\n", temp.c_str());
+        return false;
+    }
+    ok = fwrite(magic, sizeof(magic), 1, file) == 1;
+    return ok;
+}
+
+FILE *SceneBundleWriter::begin(SceneBundle::SectionType type, const std::string &name) {
+    sectionStart = ftell(file);
+    sectionHeader h = {type, (uint32_t) name.size(), 0};
+    ok = ok && fwrite(&h, sizeof(h), 1, file) == 1 && fwrite(name.data(), 1, name.size(), file) == name.size();
+    return file;
+}
+
+bool SceneBundleWriter::end() {
+    // the size is only known now, so the header is patched
+    long sectionEnd = ftell(file);
+    sectionHeader h;
+    ok = ok && sectionEnd >= 0 && fseek(file, sectionStart, SEEK_SET) == 0 &&
+        fread(&h, sizeof(h), 1, file) == 1;
+    if (ok) {
+        h.size = sectionEnd - sectionStart - sizeof(h) - h.nameLength;
+        static const char zeros[8] = {0};
+        size_t padding = align8(sectionEnd) - sectionEnd;
+        ok = fseek(file, sectionStart, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, file) == 1 &&
+            fseek(file, sectionEnd, SEEK_SET) == 0 && fwrite(zeros, 1, padding, file) == padding;
+    }
+    return ok;
+}
+
+bool SceneBundleWriter::add(SceneBundle::SectionType type, const std::string &name, const char *data, size_t size) {
+    begin(type, name);
+    ok = ok && fwrite(data, 1, size, file) == size;
+    return end();
+}
+
+bool SceneBundleWriter::close() {
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok || rename(temp.c_str(), target.c_str()) != 0) {
+        printf("cannot write scene bundle '%s'\n", target.c_str());
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -7,6 +7,9 @@
 #include <cstdlib>
 #include <cmath>
 #include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
 
 #include "scene_parser.hpp"
 #include "camera.hpp"
@@ -21,6 +24,8 @@
 #include "curve.hpp"
 #include "revsurface.hpp"
 #include "transform.hpp"
+#include "scene_bundle.hpp"
+#include "mapped_file.hpp"
 
 #define DegreesToRadians(x) ((M_PI * x) / 180.0f)
 
@@ -31,6 +36,8 @@ SceneParser::SceneParser(const char *filename) {
     camera = nullptr;
     num_lights = 0;
     lights = nullptr;
+    num_area_lights = 0;
+    area_lights = nullptr;
     num_textures = 0;
     textures = nullptr;
     num_materials = 0;
@@ -38,19 +45,44 @@ SceneParser::SceneParser(const char *filename) {
     current_material = nullptr;
     omp_threads = 1;
     antialias = 0;
+    integrator = 0;
+    sampler_type = 0;
+    packet_size = 16;
+    adaptive = false;
+    minSPP = 16;
+    maxSPP = 0;
+    threshold = 0.01;
+    heatmap = false;
+    progressive = false;
     gamma = 1;
     background_color = Vector3f::ZERO;
     tmin = 1e-4;
+    maxDepth = 64;
+    rrDepth = 3;
+    tile_size = 16;
+    tile_order = 1;
 
     // parse the file
     assert(filename != nullptr);
     const char *ext = &filename[strlen(filename) - 4];
 
-    if (strcmp(ext, ".txt") != 0) {
+    scene_file = filename;
+    bundle = nullptr;
+    if (!strcmp(ext, ".pa4")) {
+        // the scene text is tokenized straight from the mapped bundle
+        bundle = new SceneBundle();
+        const SceneBundle::Section *scene = nullptr;
+        if (bundle->open(filename)) scene = bundle->find(SceneBundle::SCENE, "");
+        if (scene == nullptr || scene->size == 0) {
+            printf("cannot open scene bundle\n");
+            exit(0);
+        }
+        file = fmemopen((void *) scene->data, scene->size, "r");
+    } else if (strcmp(ext, ".txt") != 0) {
         printf("wrong file name extension\n");
         exit(0);
-    }
-    file = fopen(filename, "r");
+    } else
+        file = fopen(filename, "r");
 
     if (file == nullptr) {
         printf("cannot open scene file\n");
@@ -59,10 +91,22 @@ SceneParser::SceneParser(const char *filename) {
     parseFile();
     fclose(file);
     file = nullptr;
+    runLoadTasks();
+    // everything has been copied out of the bundle
+    delete bundle;
+    bundle = nullptr;
 
     if (num_lights == 0) {
         printf("WARNING:    No lights specified\n");
     }
+    if (progressive && adaptive) {
+        printf("WARNING:    adaptive sampling is ignored in progressive mode\n");
+        adaptive = false;
+    }
+    if (integrator == 1 && adaptive) {
+        printf("WARNING:    adaptive sampling is ignored by the wavefront integrator\n");
+        adaptive = false;
+    }
 }
 
 SceneParser::~SceneParser() {
@@ -79,6 +123,7 @@ SceneParser::~SceneParser() {
         delete lights[i];
     }
     delete[] lights;
+    delete[] area_lights;
 }
 
 // ====================================================================
@@ -169,6 +214,28 @@ void SceneParser::parseModel() {
                 printf("Unknown sampling style: '%s'\n", token);
                 assert(0);
             }
+        } else if (!strcmp(token, "integrator")) {
+            getToken(token);
+            if (!strcmp(token, "path")) integrator = 0;
+            else if (!strcmp(token, "wavefront")) integrator = 1;
+            else {
+                printf("Unknown integrator: '%s'\n", token);
+                assert(0);
+            }
+        } else if (!strcmp(token, "sampler")) {
+            getToken(token);
+            if (!strcmp(token, "pcg")) sampler_type = 0;
+            else if (!strcmp(token, "sobol")) sampler_type = 1;
+            else {
+                printf("Unknown sampler: '%s'\n", token);
+                assert(0);
+            }
+        } else if (!strcmp(token, "packet")) {
+            packet_size = readInt();
+            if (packet_size != 1 && packet_size != 4 && packet_size != 8 && packet_size != 16) {
+                printf("Unsupported packet size: %d\n", packet_size);
+                assert(0);
+            }
         } else if (!strcmp(token, "antialias")) {
             getToken(token);
             assert(!strcmp(token, "{"));
@@ -187,6 +254,50 @@ void SceneParser::parseModel() {
                     break;
                 }
             }
+        } else if (!strcmp(token, "adaptive")) {
+            adaptive = true;
+            getToken(token);
+            assert(!strcmp(token, "{"));
+            while (true) {
+                getToken(token);
+                if (!strcmp(token, "minSPP")) {
+                    minSPP = readInt();
+                } else if (!strcmp(token, "maxSPP")) {
+                    maxSPP = readInt();
+                } else if (!strcmp(token, "threshold")) {
+                    threshold = readFloat();
+                } else if (!strcmp(token, "heatmap")) {
+                    getToken(token);
+                    heatmap = !strcmp(token, "true");
+                } else {
+                    assert(!strcmp(token, "}"));
+                    break;
+                }
+            }
+        } else if (!strcmp(token, "progressive")) {
+            getToken(token);
+            progressive = !strcmp(token, "true");
+        } else if (!strcmp(token, "tiles")) {
+            getToken(token);
+            assert(!strcmp(token, "{"));
+            while (true) {
+                getToken(token);
+                if (!strcmp(token, "size")) {
+                    tile_size = readInt();
+                } else if (!strcmp(token, "order")) {
+                    getToken(token);
+                    if (!strcmp(token, "scanline")) tile_order = 0;
+                    else if (!strcmp(token, "Hilbert")) tile_order = 1;
+                    else if (!strcmp(token, "center-out")) tile_order = 2;
+                    else {
+                        printf("Unknown tile order: '%s'\n", token);
+                        assert(0);
+                    }
+                } else {
+                    assert(!strcmp(token, "}"));
+                    break;
+                }
+            }
         } else if (!strcmp(token, "OMP")) {
             omp_threads = readInt();
         } else if (!strcmp(token, "background")) {
@@ -197,6 +308,10 @@ void SceneParser::parseModel() {
             gamma = readFloat();
         } else if (!strcmp(token, "rrProb")) {
             rrProb = readFloat();
+        } else if (!strcmp(token, "maxDepth")) {
+            maxDepth = readInt();
+        } else if (!strcmp(token, "rrDepth")) {
+            rrDepth = readInt();
         } else if (!strcmp(token, "tmin")) {
             tmin = readFloat();
         } else {
@@ -218,6 +333,7 @@ void SceneParser::parseLights() {
     assert (!strcmp(token, "numLights"));
     num_lights = readInt();
     lights = new Light *[num_lights];
+    area_lights = new AreaLight *[num_lights];
     // read in the objects
     int count = 0;
     while (num_lights > count) {
@@ -227,9 +343,9 @@ void SceneParser::parseLights() {
         } else if (strcmp(token, "PointLight") == 0) {
             lights[count] = parsePointLight();
         } else if (strcmp(token, "RectLight") == 0) {
-            lights[count] = parseRectLight();
+            lights[count] = area_lights[num_area_lights++] = parseRectLight();
         } else if (strcmp(token, "CircleLight") == 0) {
-            lights[count] = parseCircleLight();
+            lights[count] = area_lights[num_area_lights++] = parseCircleLight();
         } else {
             printf("Unknown token in parseLight: '%s'\n", token);
             exit(0);
@@ -270,7 +386,7 @@ Light *SceneParser::parsePointLight() {
     return new PointLight(position, color);
 }
 
-Light *SceneParser::parseRectLight() {
+AreaLight *SceneParser::parseRectLight() {
     char token[MAX_PARSER_TOKEN_LENGTH];
     getToken(token);
     assert (!strcmp(token, "{"));
@@ -304,7 +420,7 @@ Light *SceneParser::parseRectLight() {
     return new RectLight(w, z, x1, y1, x2, y2, color);
 }
 
-Light *SceneParser::parseCircleLight() {
+AreaLight *SceneParser::parseCircleLight() {
     char token[MAX_PARSER_TOKEN_LENGTH];
     getToken(token);
     assert (!strcmp(token, "{"));
@@ -355,7 +471,10 @@ void SceneParser::parseTextures() {
         if (!strcmp(token, "Texture")) {
             getToken(token);
             textures[count] = new Texture();
-            textures[count]->set(token);
+            const SceneBundle::Section *section = bundle ? bundle->find(SceneBundle::TEXTURE, token) : nullptr;
+            if (section) textures[count]->set(token, section->data, section->size);
+            else textures[count]->set(token);
+            texture_files.push_back(token);
         }
         else {
             printf("Unknown token in parseTextures: '%s'\n", token);
@@ -603,6 +722,72 @@ Object3D *SceneParser::parseObject(char token[MAX_PARSER_TOKEN_LENGTH]) {
 // ====================================================================
 // ====================================================================
 
+bool SceneParser::saveBundle(const char *filename) const {
+    MappedFile text(scene_file.c_str());
+    SceneBundleWriter writer;
+    if (!text.isOpen() || !writer.open(filename)) return false;
+    bool ok = writer.add(SceneBundle::SCENE, "", text.data(), text.size());
+    for (const std::string &name : texture_files) {
+        MappedFile texture(name.c_str());
+        if (!texture.isOpen()) printf("WARNING:    cannot bundle texture '%s'\n", name.c_str());
+        else ok = ok && writer.add(SceneBundle::TEXTURE, name, texture.data(), texture.size());
+    }
+    std::vector <std::string> written;
+    for (const auto &mesh : bundle_meshes) {
+        if (std::find(written.begin(), written.end(), mesh.first) != written.end()) continue;
+        written.push_back(mesh.first);
+        ok = ok && mesh.second->writeCache(writer.begin(SceneBundle::MESH, mesh.first), 0) && writer.end();
+    }
+    ok = writer.close() && ok;
+    if (ok) printf("bundle: %s with %d meshes and %d textures\n", filename,
+        (int) written.size(), (int) texture_files.size());
+    return ok;
+}
+
+bool SceneParser::loadCamera(const char *filename) {
+    file = fopen(filename, "r");
+    if (file == nullptr) {
+        printf("cannot open camera file '%s'\n", filename);
+        return false;
+    }
+    char token[MAX_PARSER_TOKEN_LENGTH];
+    bool found = false;
+    while (getToken(token)) {
+        if (strcmp(token, "PerspectiveCamera")) {
+            printf("Unknown token in camera file: '%s'\n", token);
+            break;
+        }
+        delete camera;
+        parsePerspectiveCamera();
+        found = true;
+    }
+    fclose(file);
+    file = nullptr;
+    return found;
+}
+
+// ====================================================================
+// ====================================================================
+
+void SceneParser::runLoadTasks() {
+    auto start = std::chrono::high_resolution_clock::now();
+    int tasks = load_tasks.size();
+    // a lone mesh runs outside the loop's threads, so that its BVH build can use them
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(std::max(1, omp_threads)) if (tasks > 1)
+    for (int i = 0; i < tasks; i++)
+        load_tasks[i]();
+    load_tasks.clear();
+    for (Group *g : groups) g->buildBVH();
+    groups.clear();
+    auto end = std::chrono::high_resolution_clock::now();
+    if (tasks > 0)
+        printf("scene: %d meshes loaded in %.2lfms\n", tasks,
+            std::chrono::duration_cast <std::chrono::microseconds> (end - start).count() / 1000.);
+}
+
+// ====================================================================
+// ====================================================================
+
 Group *SceneParser::parseGroup() {
     //
     // each group starts with an integer that specifies
@@ -642,6 +827,8 @@ Group *SceneParser::parseGroup() {
     }
     getToken(token);
     assert (!strcmp(token, "}"));
+    // bounded once its meshes are loaded
+    groups.push_back(answer);
 
     // return the group
     return answer;
@@ -715,15 +902,62 @@ Mesh *SceneParser::parseTriangleMesh() {
     getToken(filename);
     const char *ext = &filename[strlen(filename) - 4];
     assert(!strcmp(ext, ".obj"));
-    Mesh *answer = new Mesh(filename, current_material);
-    getToken(token);
-    if (!strcmp(token, "use_BVH")) {
-        getToken(token);
-        if (!strcmp(token, "true"))
-            answer->buildBVH();
+    Mesh *answer = new Mesh(current_material);
+    bool useBVH = false;
+    BVH::Builder builder = BVH::MEDIAN;
+    bool useCache = true;
+    int width = 2;
+    while (true) {
         getToken(token);
+        if (!strcmp(token, "use_BVH")) {
+            // true / median: median split, SAH: binned surface area heuristic
+            getToken(token);
+            useBVH = true;
+            if (!strcmp(token, "true") || !strcmp(token, "median"))
+                builder = BVH::MEDIAN;
+            else if (!strcmp(token, "SAH"))
+                builder = BVH::SAH;
+            else if (!strcmp(token, "false"))
+                useBVH = false;
+            else {
+                printf("Unknown BVH builder: '%s'\n", token);
+                assert(0);
+            }
+        } else if (!strcmp(token, "BVH_cache")) {
+            // keep the BVH in <obj_file>.bvhcache for later runs (default true)
+            getToken(token);
+            useCache = !strcmp(token, "true");
+        } else if (!strcmp(token, "BVH_width")) {
+            // 2: binary nodes, 4: SSE nodes, 8: AVX2 nodes
+            width = readInt();
+            assert(width == 2 || width == 4 || width == 8);
+        } else {
+            assert (!strcmp(token, "}"));
+            break;
+        }
     }
-    assert (!strcmp(token, "}"));
+    std::string path = filename;
+    // a bundle keeps a mesh per file and builder; names have no spaces, being tokens
+    std::string section = path + (!useBVH ? "" : builder == BVH::SAH ? " SAH" : " median");
+    bundle_meshes.emplace_back(section, answer);
+    // omp_threads is read when the task runs, as the Model block may come later
+    load_tasks.emplace_back([this, answer, path, section, useBVH, useCache, builder, width]() {
+        if (bundle) {
+            const SceneBundle::Section *s = bundle->find(SceneBundle::MESH, section);
+            if (s && answer->loadCache(s->data, s->size, 0, width, section.c_str())) return;
+            printf("WARNING:    '%s' is not in the bundle, loading the OBJ file\n", section.c_str());
+        }
+        std::string cacheFile = path + ".bvhcache";
+        uint64_t key = 0;
+        if (useBVH && useCache) {
+            key = Mesh::cacheKey(path.c_str(), builder, width);
+            if (answer->loadCache(cacheFile.c_str(), key, width)) return;
+        }
+        answer->load(path.c_str());
+        if (!useBVH) return;
+        answer->buildBVH(builder, width, omp_threads);
+        if (useCache) answer->saveCache(cacheFile.c_str(), key);
+    });
     return answer;
 }
 
@@ -806,7 +1040,9 @@ RevSurface *SceneParser::parseRevSurface() {
             break;
         }
     }
-    return new RevSurface(profile, current_material, step1, step2, isNewton);
+    RevSurface *answer = new RevSurface(profile, current_material, step1, step2, isNewton);
+    load_tasks.emplace_back([=]() { answer->buildMesh(); });
+    return answer;
 }
 
 
@@ -0,0 +1,72 @@
+/*
+原创性：独立实现
+*/
+
+#include "scheduler.hpp"
+#include <algorithm>
+
+namespace {
+    // position of (x, y) along the Hilbert curve filling an n x n grid, n a power of 2
+    long long hilbertIndex(int n, int x, int y) {
+        long long d = 0;
+        for (int s = n / 2; s > 0; s /= 2) {
+            int rx = (x & s) > 0, ry = (y & s) > 0;
+            d += (long long) s * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) x = n - 1 - x, y = n - 1 - y;
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+}
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, Order order) {
+    if (tileSize < 1) tileSize = 1;
+    int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    std::vector <long long> key;
+    int n = 1;
+    while (n < tilesX || n < tilesY) n *= 2;
+    for (int ty = 0; ty < tilesY; ty++)
+        for (int tx = 0; tx < tilesX; tx++) {
+            tile t;
+            t.x0 = tx * tileSize, t.x1 = std::min(width, t.x0 + tileSize);
+            t.y0 = ty * tileSize, t.y1 = std::min(height, t.y0 + tileSize);
+            t.id = tiles.size();
+            tiles.push_back(t);
+            if (order == HILBERT) key.push_back(hilbertIndex(n, tx, ty));
+            else if (order == CENTER_OUT) {
+                // squared distance of the tile center to the image center, in half pixels
+                long long dx = t.x0 + t.x1 - width, dy = t.y0 + t.y1 - height;
+                key.push_back(dx * dx + dy * dy);
+            }
+            else key.push_back(t.id);
+        }
+    std::stable_sort(tiles.begin(), tiles.end(), [&](const tile &a, const tile &b) {
+        return key[a.id] < key[b.id];
+    });
+}
+
+bool TileScheduler::next(std::vector <worker> &workers, int self, tile &t) {
+    {
+        std::lock_guard <std::mutex> guard(workers[self].lock);
+        if (!workers[self].tiles.empty()) {
+            t = workers[self].tiles.front();
+            workers[self].tiles.pop_front();
+            return true;
+        }
+    }
+    // steal the last tile of the next worker that still has some; the back is the
+    // tile its owner would reach last, so the owner keeps its locality
+    int threads = workers.size();
+    for (int k = 1; k < threads; k++) {
+        worker &victim = workers[(self + k) % threads];
+        std::lock_guard <std::mutex> guard(victim.lock);
+        if (!victim.tiles.empty()) {
+            t = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -8,18 +8,25 @@
 #include "stb_image.h"
 #include "texture.hpp"
 
-#include <unistd.h>
-
 void Texture::set(const char *filename) {
-	char cwd[1024];
-	getcwd(cwd, sizeof(cwd));
 	int channels;
 	unsigned char *data = stbi_load(filename, &width, &height, &channels, 0);
+	set(filename, data, channels);
+}
+
+void Texture::set(const char *name, const char *bytes, size_t size) {
+	int channels;
+	unsigned char *data = stbi_load_from_memory((const unsigned char *) bytes, size, &width, &height, &channels, 0);
+	set(name, data, channels);
+}
+
+void Texture::set(const char *name, unsigned char *data, int channels) {
 	image = new Image(width, height);
 	for (int y = height - 1, idx = 0; y >= 0; y--)
         for (int x = 0; x < width; x++, idx += channels)
             image->SetPixel(x, y, Vector3f(data[idx], data[idx + 1], data[idx + 2]) / 256);
-    printf("%s: %d x %d\n", filename, width, height);
+    stbi_image_free(data);
+    printf("%s: %d x %d\n", name, width, height);
 }
 
 Vector3f Texture::getColor(float u, float v) {
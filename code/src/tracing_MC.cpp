@@ -2,29 +2,36 @@
 原创性：独立实现
 */
 
+#include <algorithm>
 #include "tracing_MC.hpp"
 #include "group.hpp"
 #include "camera.hpp"
 
 namespace {
-    bool gamble(std::mt19937_64 &rnd, float rrProb) {
-        std::uniform_real_distribution <float> gen(0, 1);
-        return gen(rnd) < rrProb;
-    }
-
-    Vector3f sampling(Vector3f incident, Vector3f normal, std::mt19937_64 &rnd, BRDFMaterial *material, int sampling) {
-        if (sampling == 0 || sampling == 1) return rotate(uniformHemisphere(rnd), normal);
-        if (sampling == 2) return rotate(cosWeightedHemisphere(rnd), normal);
-        if (sampling == 3) return material->sampling(incident, normal, rnd);
+    Vector3f sampling(Vector3f incident, Vector3f normal, Sampler &sampler, BRDFMaterial *material, int sampling) {
+        if (sampling == 0 || sampling == 1) return rotate(uniformHemisphere(sampler), normal);
+        if (sampling == 2) return rotate(cosWeightedHemisphere(sampler), normal);
+        if (sampling == 3) return material->sampling(incident, normal, sampler);
         if (sampling == 4) {
-            if (gamble(rnd, 0.5))
-                return rotate(cosWeightedHemisphere(rnd), normal);
+            if (gamble(sampler, 0.5))
+                return rotate(cosWeightedHemisphere(sampler), normal);
             else
-                return material->sampling(incident, normal, rnd);
+                return material->sampling(incident, normal, sampler);
         }
         return Vector3f(0);   
     }
 
+    // base-b radical inverse of k, the k-th point of the van der Corput sequence
+    float radicalInverse(int b, int k) {
+        float result = 0, w = 1;
+        while (k) {
+            w /= b;
+            result += w * (k % b);
+            k /= b;
+        }
+        return result;
+    }
+
     float getPDF(Vector3f incident, Vector3f normal, Vector3f reflect, BRDFMaterial *material, int sampling) {
         float dot = Vector3f::dot(normal, reflect);
         if (dot < 0) return 0;
@@ -36,35 +43,56 @@ namespace {
     }
 }
 
-Vector3f tracingMC(Ray ray, SceneParser &Parser, std::mt19937_64 &rnd, AreaLight *&pLight) {
-    pLight = nullptr;
-    Group *baseGroup = Parser.getGroup();
-    Hit hit;
+bool gamble(Sampler &sampler, float rrProb) {
+    return sampler.next1D() < rrProb;
+}
+
+bool intersectScene(const Ray &ray, SceneParser &Parser, Hit &hit, AreaLight *&pLight) {
     float tmin = Parser.getTmin();
-    bool hitted = baseGroup->intersect(ray, hit, tmin);
-    for (int l = 0; l < Parser.getNumLights(); l++) {
-        AreaLight *light = dynamic_cast <AreaLight *> (Parser.getLight(l));
-        if (light && light->intersect(ray, hit, tmin)) {
+    pLight = nullptr;
+    bool hitted = Parser.getGroup()->intersect(ray, hit, tmin);
+    for (int l = 0; l < Parser.getNumAreaLights(); l++) {
+        AreaLight *light = Parser.getAreaLight(l);
+        if (light->intersect(ray, hit, tmin)) {
             hitted = true;
             if (hit.getIsFront()) pLight = light;
         }
     }
+    return hitted;
+}
 
-    if (!hitted) return Vector3f(0);
-    if (hit.getMaterial() == &LightMaterial::material) return hit.getColor();
-    if (gamble(rnd, Parser.getrrProb())) return Vector3f(0);
+float emissionWeight(const Ray &ray, const Hit &hit, AreaLight *pLight, float pdf, bool mis) {
+    if (!mis || !pLight) return 1 / pdf;
+    float p2 = hit.getT() * hit.getT() /
+        (-Vector3f::dot(hit.getNormal(), ray.getDirection()) * pLight->area());
+    return 1 / (pdf + p2);
+}
 
-    Vector3f finalColor(0);
+bool roulette(int depth, Vector3f &throughput, SceneParser &Parser, Sampler &sampler) {
+    // past rrDepth a path survives with a probability that follows its throughput,
+    // capped by 1 - rrProb
+    if (depth < Parser.getrrDepth()) return true;
+    float survive = std::min(std::max({throughput[0], throughput[1], throughput[2]}),
+        1 - Parser.getrrProb());
+    if (!gamble(sampler, survive)) return false;
+    throughput = throughput / survive;
+    return true;
+}
+
+bool scatter(const Ray &ray, const Hit &hit, SceneParser &Parser, Sampler &sampler,
+    Ray &next, Vector3f &throughput, float &pdf, bool &mis) {
     Vector3f color = hit.getColor();
     Vector3f point = ray.pointAtParameter(hit.getT());
-    AreaLight *pLight2 = nullptr;
 
-    if (dynamic_cast <ReflectiveMaterial *> (hit.getMaterial())) {
+    switch (hit.getMaterial()->getType()) {
+    case Material::REFLECTIVE: {
         Vector3f direction = getReflectDir(ray.getDirection(), hit.getNormal());
-        finalColor = color * tracingMC(Ray(point, direction), Parser, rnd, pLight2);
+        throughput = throughput * color;
+        next = Ray(point, direction);
+        return true;
     }
-    else if (dynamic_cast <RefractiveMaterial *> (hit.getMaterial())) {
-        float n = dynamic_cast <RefractiveMaterial *> (hit.getMaterial())->getN();
+    case Material::REFRACTIVE: {
+        float n = static_cast <RefractiveMaterial *> (hit.getMaterial())->getN();
         Vector3f direction; float weight;
         getRefractDir(ray.getDirection(), hit.getNormal(),
             hit.getIsFront(), n, direction, weight);
@@ -72,10 +100,12 @@ Vector3f tracingMC(Ray ray, SceneParser &Parser, std::mt19937_64 &rnd, AreaLight
             weight = 1, direction = getReflectDir(ray.getDirection(), hit.getNormal());
         else
             weight = 1 / weight;
-        finalColor = weight * color * tracingMC(Ray(point, direction), Parser, rnd, pLight2);
+        throughput = weight * color * throughput;
+        next = Ray(point, direction);
+        return true;
     }
-    else if (dynamic_cast <FresnelMaterial *> (hit.getMaterial())) {
-        FresnelMaterial *material = dynamic_cast <FresnelMaterial *> (hit.getMaterial());
+    case Material::FRESNEL: {
+        FresnelMaterial *material = static_cast <FresnelMaterial *> (hit.getMaterial());
         Vector3f direction; float weight;
         getRefractDir(ray.getDirection(), hit.getNormal(),
             hit.getIsFront(), material->getN(), direction, weight);
@@ -84,76 +114,119 @@ Vector3f tracingMC(Ray ray, SceneParser &Parser, std::mt19937_64 &rnd, AreaLight
         else {
             float prob = material->reflectProb(-Vector3f::dot(hit.getNormal(),
                 hit.getIsFront() ? ray.getDirection() : direction));
-            if (gamble(rnd, prob))
+            if (gamble(sampler, prob))
                 weight = 1, direction = getReflectDir(ray.getDirection(), hit.getNormal());
             else
                 weight = 1 / weight;
         }
-        finalColor = weight * color * tracingMC(Ray(point, direction), Parser, rnd, pLight2);
+        throughput = weight * color * throughput;
+        next = Ray(point, direction);
+        return true;
+    }
+    case Material::BRDF: {
+        BRDFMaterial *material = static_cast <BRDFMaterial *> (hit.getMaterial());
+        int samplingStyle = Parser.getSampling();
+        Vector3f reflect = sampling(ray.getDirection(), hit.getNormal(), sampler, material, samplingStyle);
+        float p1 = getPDF(ray.getDirection(), hit.getNormal(), reflect, material, samplingStyle);
+        if (Vector3f::dot(hit.getNormal(), reflect) < 0) return false;
+        throughput = throughput * color * material->getBRDF(-reflect, hit.getNormal(),
+            -ray.getDirection(), hit.getTangent()) * Vector3f::dot(hit.getNormal(), reflect);
+        pdf = p1, mis = samplingStyle != 0;
+        next = Ray(point, reflect);
+        return true;
     }
-    else if (dynamic_cast <BRDFMaterial *> (hit.getMaterial())) {
-        BRDFMaterial *material = dynamic_cast <BRDFMaterial *> (hit.getMaterial());
-        Vector3f reflect, next1, next2, constant(0);
-        float weight1 = 1, p1, p2;
+    default:
+        return false;
+    }
+}
 
-        reflect = sampling(ray.getDirection(), hit.getNormal(), rnd, material, Parser.getSampling());
-        p1 = getPDF(ray.getDirection(), hit.getNormal(), reflect, material, Parser.getSampling());
+bool sampleLight(int l, const Ray &ray, const Hit &hit, SceneParser &Parser, Sampler &sampler,
+    Ray &shadow, float &tmax, Vector3f &contribution) {
+    BRDFMaterial *material = static_cast <BRDFMaterial *> (hit.getMaterial());
+    AreaLight *light = Parser.getAreaLight(l);
+    Vector3f point = ray.pointAtParameter(hit.getT());
+    Vector3f ppp = light->sampling(sampler);
+    shadow = Ray(point, (ppp - point).normalized());
+    Hit hit2;
+    if (Vector3f::dot(shadow.getDirection(), hit.getNormal()) < 0) return false;
+    if (!light->intersect(shadow, hit2, Parser.getTmin()) || !hit2.getIsFront()) return false;
+    tmax = hit2.getT();
+    float q1 = getPDF(ray.getDirection(), hit.getNormal(),
+        shadow.getDirection(), material, Parser.getSampling());
+    float q2 = hit2.getT() * hit2.getT() /
+        (-Vector3f::dot(hit2.getNormal(), shadow.getDirection()) * light->area());
+    Vector3f next2 = material->getBRDF(-shadow.getDirection(), hit.getNormal(), -ray.getDirection(),
+        hit.getTangent()) * hit2.getColor() *
+        Vector3f::dot(hit.getNormal(), shadow.getDirection());
+    contribution = next2 / (q1 + q2);
+    return true;
+}
 
-        if (Vector3f::dot(hit.getNormal(), reflect) < 0) next1 = Vector3f(0);
-        else {
-            next1 = material->getBRDF(-reflect, hit.getNormal(), -ray.getDirection(),
-                hit.getTangent()) * tracingMC(Ray(point, reflect), Parser, rnd, pLight2) *
-                Vector3f::dot(hit.getNormal(), reflect);
-            weight1 = 1 / p1;
+bool shadowed(const Ray &shadow, float tmax, int l, SceneParser &Parser) {
+    float tmin = Parser.getTmin();
+    if (Parser.getGroup()->occluded(shadow, tmin, tmax)) return true;
+    Hit hit2(tmax, nullptr, Vector3f::ZERO, Vector3f::ZERO, false, Vector3f::ZERO);
+    for (int l0 = 0; l0 < Parser.getNumAreaLights(); l0++) {
+        if (l == l0) continue;
+        if (Parser.getAreaLight(l0)->intersect(shadow, hit2, tmin)) return true;
+    }
+    return false;
+}
+
+Vector3f tracingMC(Ray ray, SceneParser &Parser, Sampler &sampler) {
+    Vector3f radiance(0), throughput(1);
+    // pdf of the direction of the current ray; after a BRDF bounce with light
+    // sampling, an area light it hits is weighted against that strategy too
+    float pdf = 1;
+    bool mis = false;
+    const int bounceDims = scatterDims + Parser.getNumAreaLights();
+
+    for (int depth = 0; depth < Parser.getMaxDepth(); depth++) {
+        int dimension = depth * bounceDims;
+        sampler.setDimension(dimension);
+        Hit hit;
+        AreaLight *pLight;
+        if (!intersectScene(ray, Parser, hit, pLight)) break;
+        if (hit.getMaterial() == &LightMaterial::material) {
+            radiance += throughput * emissionWeight(ray, hit, pLight, pdf, mis) * hit.getColor();
+            break;
         }
-        
-        if (Parser.getSampling() != 0) {
-            if (pLight2) {
-                Hit hit2; pLight2->intersect(Ray(point, reflect), hit2, tmin);
-                p2 = hit2.getT() * hit2.getT() /
-                    (-Vector3f::dot(hit2.getNormal(), reflect) * pLight2->area());
-                weight1 = 1 / (p1 + p2);
-            }
-            for (int l = 0; l < Parser.getNumLights(); l++) {
-                AreaLight *light = dynamic_cast <AreaLight *> (Parser.getLight(l));
-                if (!light) continue;
-                Vector3f ppp = light->sampling(rnd);
-                Ray ray2(point, (ppp - point).normalized());
-                Hit hit2;
-                if (Vector3f::dot(ray2.getDirection(), hit.getNormal()) < 0) continue;
-                if (!light->intersect(ray2, hit2, tmin) || !hit2.getIsFront()) continue;
-                bool shaded = baseGroup->intersect(ray2, hit2, tmin);
-                for (int l0 = 0; l0 < Parser.getNumLights() && !shaded; l0++) {
-                    if (l == l0) continue;
-                    AreaLight *light2 = dynamic_cast <AreaLight *> (Parser.getLight(l0));
-                    if (light2 && light2->intersect(ray2, hit2, tmin)) shaded = true;
-                }
-                if (shaded) continue;
-                p1 = getPDF(ray.getDirection(), hit.getNormal(),
-                    ray2.getDirection(), material, Parser.getSampling());
-                p2 = hit2.getT() * hit2.getT() /
-                    (-Vector3f::dot(hit2.getNormal(), ray2.getDirection()) * light->area());
-                next2 = material->getBRDF(-ray2.getDirection(), hit.getNormal(), -ray.getDirection(),
-                    hit.getTangent()) * hit2.getColor() *
-                    Vector3f::dot(hit.getNormal(), ray2.getDirection());
-                constant += next2 / (p1 + p2);
+        throughput = throughput / pdf;
+        pdf = 1, mis = false;
+        if (!roulette(depth, throughput, Parser, sampler)) break;
+
+        Vector3f weight = throughput * hit.getColor();
+        Ray next = ray;
+        bool alive = scatter(ray, hit, Parser, sampler, next, throughput, pdf, mis);
+        if (hit.getMaterial()->getType() == Material::BRDF && Parser.getSampling() != 0) {
+            sampler.setDimension(dimension + scatterDims);
+            Vector3f constant(0);
+            for (int l = 0; l < Parser.getNumAreaLights(); l++) {
+                Ray shadow = ray;
+                float tmax;
+                Vector3f contribution;
+                if (sampleLight(l, ray, hit, Parser, sampler, shadow, tmax, contribution) &&
+                    !shadowed(shadow, tmax, l, Parser))
+                    constant += contribution;
             }
+            radiance += weight * constant;
         }
-        finalColor += color * (weight1 * next1 + constant);
+        if (!alive) break;
+        ray = next;
     }
-    return finalColor / (1 - Parser.getrrProb());
+    return radiance;
 }
 
-Vector3f tracingMC(int x, int y, SceneParser &Parser) {
-    int SPP = Parser.getSPP();
-    Camera* camera = Parser.getCamera();
-    std::mt19937_64 rnd(y * camera->getWidth() + x);
-    AreaLight *pLight;
-    Vector2f p0(x, y);
-    double u = 0, v = 0, w = 0;
-    for (int k = 0; k < SPP; k++) {
-        Vector2f p = p0;
-        if (Parser.getAntialias() & 1) {
+Ray cameraRay(int x, int y, int k, SceneParser &Parser, Sampler &sampler) {
+    int SPP = Parser.getAdaptive() ? Parser.getMaxSPP() : Parser.getSPP();
+    sampler.startSample(x, y, k);
+    Vector2f p(x, y);
+    if (Parser.getAntialias() & 1) {
+        // an adaptive pixel may stop at any k, so it takes a prefix of the Halton
+        // sequence instead of Hammersley points spread over the whole SPP
+        if (Parser.getAdaptive())
+            p[0] += radicalInverse(3, k), p[1] += radicalInverse(2, k);
+        else {
             p[0] += (k + 0.5) / SPP;
             int i = k; float w = 1;
             while (i) {
@@ -161,12 +234,40 @@ Vector3f tracingMC(int x, int y, SceneParser &Parser) {
                 if (i & 1) p[1] += w;
                 i /= 2;
             }
-            if (p[0] >= x + 1) p[0] -= 1;
-            if (p[1] >= y + 1) p[1] -= 1;
-            p[0] -= 0.5, p[1] -= 0.5;
         }
-        Vector3f t = tracingMC(camera->generateRay(p), Parser, rnd, pLight);
+        if (p[0] >= x + 1) p[0] -= 1;
+        if (p[1] >= y + 1) p[1] -= 1;
+        p[0] -= 0.5, p[1] -= 0.5;
+    }
+    return Parser.getCamera()->generateRay(p);
+}
+
+Vector3f tracingMC(int x, int y, int k, SceneParser &Parser, Sampler &sampler) {
+    return tracingMC(cameraRay(x, y, k, Parser, sampler), Parser, sampler);
+}
+
+Vector3f tracingMC(int x, int y, SceneParser &Parser, Sampler &sampler, int &samples) {
+    bool adaptive = Parser.getAdaptive();
+    int SPP = adaptive ? Parser.getMaxSPP() : Parser.getSPP();
+    double u = 0, v = 0, w = 0;
+    // running mean and sum of squared deviations of the sample luminance (Welford)
+    double mean = 0, m2 = 0;
+    int k = 0;
+    while (k < SPP) {
+        Vector3f t = tracingMC(x, y, k, Parser, sampler);
         u += t[0], v += t[1], w += t[2];
+        k++;
+        if (adaptive) {
+            double l = 0.2126 * t[0] + 0.7152 * t[1] + 0.0722 * t[2];
+            double delta = l - mean;
+            mean += delta / k;
+            m2 += delta * (l - mean);
+            // stop once the standard error of the mean is below threshold relative to it
+            if (k >= Parser.getMinSPP() &&
+                sqrt(m2 / (k - 1) / k) <= Parser.getThreshold() * std::max(mean, 1e-3))
+                break;
+        }
     }
-    return Vector3f(u / SPP, v / SPP, w / SPP);
+    samples = k;
+    return Vector3f(u / k, v / k, w / k);
 }
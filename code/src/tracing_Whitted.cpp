@@ -7,33 +7,37 @@
 #include "group.hpp"
 #include "light.hpp"
 #include "camera.hpp"
+#include <vector>
 
-Vector3f tracingWhitted(Ray ray, SceneParser &Parser, Vector3f rate) {
-    float tmin = Parser.getTmin();
-    if (rate.squaredLength() < 1e-6) return Vector3f::ZERO;
-    Vector3f finalColor = Parser.getBackgroundColor();
-    Group *baseGroup = Parser.getGroup();
-    Hit hit;
-    if (baseGroup->intersect(ray, hit, tmin)) {
+namespace {
+    // color seen along ray, given its closest hit
+    Vector3f shade(const Ray &ray, const Hit &hit, bool hitted, SceneParser &Parser, Vector3f rate) {
+        float tmin = Parser.getTmin();
+        Vector3f finalColor = Parser.getBackgroundColor();
+        Group *baseGroup = Parser.getGroup();
+        if (!hitted) return finalColor * rate;
         Vector3f point = ray.pointAtParameter(hit.getT());
-        if (dynamic_cast <PhongMaterial *> (hit.getMaterial())) {
-            PhongMaterial *material = dynamic_cast <PhongMaterial *> (hit.getMaterial());
+        switch (hit.getMaterial()->getType()) {
+        case Material::PHONG: {
+            PhongMaterial *material = static_cast <PhongMaterial *> (hit.getMaterial());
             finalColor = finalColor * (material->getAmbientColor());
             for (int l = 0; l < Parser.getNumLights(); l++) {
                 Light *light = Parser.getLight(l);
                 Vector3f L, lightColor;
-                float dist; Hit hit2;
+                float dist;
                 light->getIllumination(point, L, lightColor, dist);
-                if (!baseGroup->intersect(Ray(point, L), hit2, tmin) || hit2.getT() > dist)
+                if (!baseGroup->occluded(Ray(point, L), tmin, dist))
                     finalColor += material->Shade(ray, hit, L, lightColor);
             }
+            break;
         }
-        else if (dynamic_cast <ReflectiveMaterial *> (hit.getMaterial())) {
+        case Material::REFLECTIVE: {
             Vector3f direction = getReflectDir(ray.getDirection(), hit.getNormal());
             finalColor += tracingWhitted(Ray(point, direction), Parser, rate * hit.getColor());
+            break;
         }
-        else if (dynamic_cast <RefractiveMaterial *> (hit.getMaterial())) {
-            RefractiveMaterial *material = dynamic_cast <RefractiveMaterial *> (hit.getMaterial());
+        case Material::REFRACTIVE: {
+            RefractiveMaterial *material = static_cast <RefractiveMaterial *> (hit.getMaterial());
             float weight = 0; Vector3f direction;
             getRefractDir(ray.getDirection(), hit.getNormal(), hit.getIsFront(), material->getN(), direction, weight);
             if (weight == 0)
@@ -41,12 +45,37 @@ Vector3f tracingWhitted(Ray ray, SceneParser &Parser, Vector3f rate) {
             else
                 weight = 1 / weight;
             finalColor += weight * tracingWhitted(Ray(point, direction), Parser, rate * hit.getColor());
+            break;
         }
+        default:
+            break;
+        }
+        return finalColor * rate;
     }
-    return finalColor * rate;
+}
+
+Vector3f tracingWhitted(Ray ray, SceneParser &Parser, Vector3f rate) {
+    if (rate.squaredLength() < 1e-6) return Vector3f::ZERO;
+    Hit hit;
+    bool hitted = Parser.getGroup()->intersect(ray, hit, Parser.getTmin());
+    return shade(ray, hit, hitted, Parser, rate);
 }
 
 Vector3f tracingWhitted(int x, int y, SceneParser &Parser) {
     Camera* camera = Parser.getCamera();
     return tracingWhitted(camera->generateRay(Vector2f(x, y)), Parser, Vector3f(1));
 }
+
+void tracingWhitted(const int *x, const int *y, int n, SceneParser &Parser, Vector3f *colors) {
+    Camera* camera = Parser.getCamera();
+    std::vector <Ray> rays;
+    rays.reserve(n);
+    for (int i = 0; i < n; i++)
+        rays.push_back(camera->generateRay(Vector2f(x[i], y[i])));
+    Hit hits[RayPacket::maxSize];
+    RayPacket packet(rays.data(), n);
+    int hitted = Parser.getGroup()->intersectPacket(packet, hits, Parser.getTmin(), (1 << n) - 1);
+    // the reflected, refracted and shadow rays that follow are incoherent, so they go one by one
+    for (int i = 0; i < n; i++)
+        colors[i] = shade(rays[i], hits[i], hitted >> i & 1, Parser, Vector3f(1));
+}
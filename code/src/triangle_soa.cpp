@@ -0,0 +1,132 @@
+/*
+原创性：独立实现
+*/
+
+#include "triangle_soa.hpp"
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+void TriangleSoA::resize(int n) {
+    size = n;
+    for (auto &c : comp) c.assign(size + lanes, 0);
+}
+
+void TriangleSoA::set(int i, const Vector3f &a, const Vector3f &b, const Vector3f &c) {
+    Vec3 A(a), edge1 = Vec3(b) - A, edge2 = Vec3(c) - A;
+    for (int d = 0; d < 3; d++) {
+        comp[AX + d][i] = A[d];
+        comp[E1X + d][i] = edge1[d];
+        comp[E2X + d][i] = edge2[d];
+    }
+}
+
+void TriangleSoA::permute(const std::vector <int> &order) {
+    std::vector <float> tmp(size + lanes, 0);
+    for (auto &c : comp) {
+        for (int i = 0; i < size; i++) tmp[i] = c[order[i]];
+        c.swap(tmp);
+    }
+}
+
+// Same arithmetic, in the same order, as Triangle::intersect. On equal
+// distances the later triangle wins, as in a plain loop over the leaf.
+int TriangleSoA::intersectScalar(const Ray &r, int first, int count, float tmin, float &tmax, float &u, float &v) const {
+    const Vector3f &o = r.getOrigin(), &dir = r.getDirection();
+    int best = -1;
+    for (int i = first; i < first + count; i++) {
+        float e1x = comp[E1X][i], e1y = comp[E1Y][i], e1z = comp[E1Z][i];
+        float e2x = comp[E2X][i], e2y = comp[E2Y][i], e2z = comp[E2Z][i];
+        float px = dir[1] * e2z - dir[2] * e2y;
+        float py = dir[2] * e2x - dir[0] * e2z;
+        float pz = dir[0] * e2y - dir[1] * e2x;
+        float a = e1x * px + e1y * py + e1z * pz;
+        if (fabsf(a) < 1e-8) continue;
+        float f = 1 / a;
+        float sx = o[0] - comp[AX][i], sy = o[1] - comp[AY][i], sz = o[2] - comp[AZ][i];
+        float u0 = f * (sx * px + sy * py + sz * pz);
+        if (u0 < 0 || u0 > 1) continue;
+        float qx = sy * e1z - sz * e1y;
+        float qy = sz * e1x - sx * e1z;
+        float qz = sx * e1y - sy * e1x;
+        float v0 = f * (dir[0] * qx + dir[1] * qy + dir[2] * qz);
+        if (v0 < 0 || u0 + v0 > 1) continue;
+        float t = f * (qx * e2x + qy * e2y + qz * e2z);
+        if (t < tmin || t > tmax) continue;
+        tmax = t, u = u0, v = v0, best = i;
+    }
+    return best;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace {
+    const bool hasAVX2 = __builtin_cpu_supports("avx2");
+
+    __attribute__((target("avx2")))
+    int intersectAVX2(const std::vector <float> *comp, const Ray &r,
+        int first, int count, float tmin, float &tmax, float &uBest, float &vBest) {
+        const Vector3f &o = r.getOrigin(), &dir = r.getDirection();
+        __m256 dx = _mm256_set1_ps(dir[0]), dy = _mm256_set1_ps(dir[1]), dz = _mm256_set1_ps(dir[2]);
+        __m256 ox = _mm256_set1_ps(o[0]), oy = _mm256_set1_ps(o[1]), oz = _mm256_set1_ps(o[2]);
+        __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+        __m256 eps = _mm256_set1_ps(1e-8f), tLow = _mm256_set1_ps(tmin);
+        __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        __m256i laneId = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        int best = -1;
+        for (int base = first; base < first + count; base += 8) {
+            __m256 e1x = _mm256_loadu_ps(comp[3].data() + base);
+            __m256 e1y = _mm256_loadu_ps(comp[4].data() + base);
+            __m256 e1z = _mm256_loadu_ps(comp[5].data() + base);
+            __m256 e2x = _mm256_loadu_ps(comp[6].data() + base);
+            __m256 e2y = _mm256_loadu_ps(comp[7].data() + base);
+            __m256 e2z = _mm256_loadu_ps(comp[8].data() + base);
+            __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+            __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+            __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+            __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px),
+                _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+            __m256 f = _mm256_div_ps(one, a);
+            __m256 sx = _mm256_sub_ps(ox, _mm256_loadu_ps(comp[0].data() + base));
+            __m256 sy = _mm256_sub_ps(oy, _mm256_loadu_ps(comp[1].data() + base));
+            __m256 sz = _mm256_sub_ps(oz, _mm256_loadu_ps(comp[2].data() + base));
+            __m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px),
+                _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)));
+            __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+            __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+            __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+            __m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx),
+                _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+            __m256 t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, e2x),
+                _mm256_mul_ps(qy, e2y)), _mm256_mul_ps(qz, e2z)));
+
+            __m256 ok = _mm256_cmp_ps(_mm256_and_ps(a, absMask), eps, _CMP_GE_OQ);
+            ok = _mm256_and_ps(ok, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+            ok = _mm256_and_ps(ok, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+            ok = _mm256_and_ps(ok, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+            ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+            ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, tLow, _CMP_GE_OQ));
+            ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, _mm256_set1_ps(tmax), _CMP_LE_OQ));
+            __m256i inRange = _mm256_cmpgt_epi32(_mm256_set1_epi32(first + count - base), laneId);
+            int mask = _mm256_movemask_ps(_mm256_and_ps(ok, _mm256_castsi256_ps(inRange)));
+            if (!mask) continue;
+
+            alignas(32) float ts[8], us[8], vs[8];
+            _mm256_store_ps(ts, t);
+            _mm256_store_ps(us, u);
+            _mm256_store_ps(vs, v);
+            for (int k = 0; k < 8; k++)
+                if ((mask >> k & 1) && ts[k] <= tmax)
+                    tmax = ts[k], uBest = us[k], vBest = vs[k], best = base + k;
+        }
+        return best;
+    }
+}
+#endif
+
+int TriangleSoA::intersect(const Ray &r, int first, int count, float tmin, float &tmax, float &u, float &v) const {
+#if defined(__x86_64__) || defined(__i386__)
+    if (hasAVX2) return intersectAVX2(comp, r, first, count, tmin, tmax, u, v);
+#endif
+    return intersectScalar(r, first, count, tmin, tmax, u, v);
+}
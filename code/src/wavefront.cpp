@@ -0,0 +1,188 @@
+/*
+原创性：独立实现
+*/
+
+#include <algorithm>
+#include "wavefront.hpp"
+#include "tracing_MC.hpp"
+#include "material.hpp"
+#include "camera.hpp"
+
+namespace {
+    // paths in flight at once; a tile takes as many waves as its samples need
+    const int waveSize = 1 << 16;
+
+    // stable counting sort: order becomes 0 .. n - 1 sorted by key(j) in [0, buckets)
+    template <typename F>
+    void sortByKey(int n, int buckets, F &&key, std::vector <int> &order) {
+        std::vector <int> start(buckets + 1, 0);
+        for (int j = 0; j < n; j++) start[key(j) + 1]++;
+        for (int b = 0; b < buckets; b++) start[b + 1] += start[b];
+        order.resize(n);
+        for (int j = 0; j < n; j++) order[start[key(j)]++] = j;
+    }
+
+    int octant(const std::vector <float> *direction, int j) {
+        return (direction[0][j] < 0) | (direction[1][j] < 0) << 1 | (direction[2][j] < 0) << 2;
+    }
+}
+
+void WavefrontIntegrator::RayQueue::clear() {
+    for (int d = 0; d < 3; d++) origin[d].clear(), direction[d].clear();
+    path.clear();
+}
+
+void WavefrontIntegrator::RayQueue::push(const Ray &r, int p) {
+    for (int d = 0; d < 3; d++) {
+        origin[d].push_back(r.getOrigin()[d]);
+        direction[d].push_back(r.getDirection()[d]);
+    }
+    path.push_back(p);
+}
+
+Ray WavefrontIntegrator::RayQueue::get(int j) const {
+    return Ray(Vector3f(origin[0][j], origin[1][j], origin[2][j]),
+        Vector3f(direction[0][j], direction[1][j], direction[2][j]));
+}
+
+void WavefrontIntegrator::RayQueue::gather(const RayQueue &from, const std::vector <int> &order) {
+    int n = order.size();
+    for (int d = 0; d < 3; d++) {
+        origin[d].resize(n), direction[d].resize(n);
+        for (int j = 0; j < n; j++) {
+            origin[d][j] = from.origin[d][order[j]];
+            direction[d][j] = from.direction[d][order[j]];
+        }
+    }
+    path.resize(n);
+    for (int j = 0; j < n; j++) path[j] = from.path[order[j]];
+}
+
+void WavefrontIntegrator::ShadowQueue::clear() {
+    RayQueue::clear();
+    tmax.clear(), light.clear();
+    for (int d = 0; d < 3; d++) contribution[d].clear();
+}
+
+void WavefrontIntegrator::ShadowQueue::push(const Ray &r, int p, float t, int l, const Vector3f &c) {
+    RayQueue::push(r, p);
+    tmax.push_back(t), light.push_back(l);
+    for (int d = 0; d < 3; d++) contribution[d].push_back(c[d]);
+}
+
+WavefrontIntegrator::WavefrontIntegrator(SceneParser &Parser_) :
+    Parser(Parser_), width(Parser_.getCamera()->getWidth()) {}
+
+void WavefrontIntegrator::render(const TileScheduler::tile &t, int first, int last, double *sum) {
+    int tileWidth = t.x1 - t.x0, pixels = tileWidth * (t.y1 - t.y0);
+    int step = std::max(1, waveSize / pixels);
+    for (int k0 = first; k0 < last; k0 += step) {
+        int k1 = std::min(last, k0 + step), samples = k1 - k0;
+        if (Parser.getSamplerType() == 1) renderWave(t, k0, k1, sobol);
+        else renderWave(t, k0, k1, pcg);
+        // in sample order per pixel, as tracingMC sums them
+        for (int i = 0; i < pixels; i++) {
+            double *s = &sum[3 * ((t.y0 + i / tileWidth) * width + t.x0 + i % tileWidth)];
+            for (int p = i * samples; p < (i + 1) * samples; p++)
+                for (int d = 0; d < 3; d++) s[d] += radiance[d][p];
+        }
+    }
+}
+
+template <typename S>
+void WavefrontIntegrator::renderWave(const TileScheduler::tile &t, int first, int last, std::vector <S> &samplers) {
+    int samples = last - first, tileWidth = t.x1 - t.x0;
+    int n = tileWidth * (t.y1 - t.y0) * samples;
+    for (int d = 0; d < 3; d++) {
+        throughput[d].assign(n, 1), radiance[d].assign(n, 0);
+        lightWeight[d].resize(n), lightSum[d].resize(n);
+    }
+    pdf.assign(n, 1), mis.assign(n, false);
+    samplers.resize(n);
+
+    // generate: path p is sample first + p % samples of the (p / samples)-th pixel of the tile
+    next.clear();
+    for (int p = 0; p < n; p++) {
+        int pixel = p / samples;
+        next.push(cameraRay(t.x0 + pixel % tileWidth, t.y0 + pixel / tileWidth,
+            first + p % samples, Parser, samplers[p]), p);
+    }
+
+    const int bounceDims = scatterDims + Parser.getNumAreaLights();
+    bool sampleLights = Parser.getSampling() != 0;
+    for (int depth = 0; depth < Parser.getMaxDepth(); depth++) {
+        // compact: the rays of the paths still alive, sorted by direction octant
+        sortByKey(next.size(), 8, [&] (int j) { return octant(next.direction, j); }, order);
+        rays.gather(next, order);
+        int m = rays.size();
+        if (!m) break;
+
+        // intersect
+        hits.assign(m, Hit());
+        hitLights.resize(m), hitted.resize(m);
+        for (int j = 0; j < m; j++)
+            hitted[j] = intersectScene(rays.get(j), Parser, hits[j], hitLights[j]);
+
+        // shade, grouped by material; misses come first and end their paths
+        sortByKey(m, Material::BRDF + 2, [&] (int j) {
+            return hitted[j] ? hits[j].getMaterial()->getType() + 1 : 0;
+        }, order);
+        next.clear(), shadows.clear(), sampled.clear();
+        for (int j : order) {
+            if (!hitted[j]) continue;
+            int p = rays.path[j];
+            S &sampler = samplers[p];
+            int dimension = depth * bounceDims;
+            sampler.setDimension(dimension);
+            const Hit &hit = hits[j];
+            Ray ray = rays.get(j);
+            Vector3f T(throughput[0][p], throughput[1][p], throughput[2][p]);
+            if (hit.getMaterial() == &LightMaterial::material) {
+                Vector3f L = T * emissionWeight(ray, hit, hitLights[j], pdf[p], mis[p]) * hit.getColor();
+                for (int d = 0; d < 3; d++) radiance[d][p] += L[d];
+                continue;
+            }
+            T = T / pdf[p];
+            float P = 1;
+            bool M = false;
+            if (!roulette(depth, T, Parser, sampler)) continue;
+
+            Vector3f weight = T * hit.getColor();
+            Ray r = ray;
+            bool alive = scatter(ray, hit, Parser, sampler, r, T, P, M);
+            if (hit.getMaterial()->getType() == Material::BRDF && sampleLights) {
+                sampler.setDimension(dimension + scatterDims);
+                for (int l = 0; l < Parser.getNumAreaLights(); l++) {
+                    Ray shadow = ray;
+                    float tmax;
+                    Vector3f contribution;
+                    if (sampleLight(l, ray, hit, Parser, sampler, shadow, tmax, contribution))
+                        shadows.push(shadow, p, tmax, l, contribution);
+                }
+                for (int d = 0; d < 3; d++) lightWeight[d][p] = weight[d], lightSum[d][p] = 0;
+                sampled.push_back(p);
+            }
+            if (!alive) continue;
+            for (int d = 0; d < 3; d++) throughput[d][p] = T[d];
+            pdf[p] = P, mis[p] = M;
+            next.push(r, p);
+        }
+
+        // shadow: rays are tested in octant order but summed in the order of the lights
+        int s = shadows.size();
+        sortByKey(s, 8, [&] (int j) { return octant(shadows.direction, j); }, order);
+        visible.resize(s);
+        for (int j : order)
+            visible[j] = !shadowed(shadows.get(j), shadows.tmax[j], shadows.light[j], Parser);
+        for (int j = 0; j < s; j++) {
+            if (!visible[j]) continue;
+            int p = shadows.path[j];
+            for (int d = 0; d < 3; d++) lightSum[d][p] += shadows.contribution[d][j];
+        }
+        for (int p : sampled) {
+            Vector3f L = Vector3f(lightWeight[0][p], lightWeight[1][p], lightWeight[2][p]) *
+                Vector3f(lightSum[0][p], lightSum[1][p], lightSum[2][p]);
+            for (int d = 0; d < 3; d++) radiance[d][p] += L[d];
+        }
+    }
+}